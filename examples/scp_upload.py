@@ -18,7 +18,7 @@
 # along with this library; if not, write to the Free Software Foundation, Inc.,
 # 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #
-import socket, sys
+import os, socket, sys
 
 import libssh2
 
@@ -52,18 +52,12 @@ class MySCPClient:
             print e
 
     def send(self, remote_path, mode=0644):
-        datas=""
         f=file(remote_path, "rb")
-        while True:
-            data = f.readline()
-            if  len(data) == 0: 
-                break
-            else:
-                datas += data
-        file_size = len(datas)
+        file_size = os.fstat(f.fileno()).st_size
         channel = self.session.scp_send(remote_path, mode, file_size)
-        channel.write(datas)
+        channel.sendfile(f)
         channel.close()
+        f.close()
 
     def __del__(self):
         self.session.close()
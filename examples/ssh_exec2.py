@@ -2,7 +2,6 @@
 import sys
 
 import socket
-from select import select
 
 import libssh2
 
@@ -38,15 +37,7 @@ class SSHRemoteClientNonBlocking(object):
         Find out from libssh2 if its blocked on read or write and wait accordingly
         Return immediately if libssh2 is not blocked
         '''
-        blockdir = self.session.blockdirections()
-        if blockdir == 0:
-            # return if not blocked
-            return
-
-        readfds = [self.sock] if (blockdir & 01) else []
-        writefds = [self.sock] if (blockdir & 02) else []
-        select(readfds, writefds, [])        
-        return
+        self.session.wait()
 
 
     def startup(self):
@@ -93,23 +84,12 @@ class SSHRemoteClientNonBlocking(object):
         my_print("channel pty ret is %s" %ret)
         
     def execute(self, cmd):
-        count = 1
-        ret = self.chan.execute(cmd)
-        while ret == self.LIBSSH2_ERROR_EAGAIN:
-            count += 1
-            self._wait_select()
-            ret = self.chan.execute(cmd)
-
-        my_print("execute count is %s" %count)
-        my_print("execute ret is %s" %ret)
-
-        while not self.chan.eof():
-            self._wait_select()
-            data1 = self.chan.read_ex()
-            while data1[0] > 0:
+        for stream_id, data in self.chan.exec_stream(cmd):
+            if stream_id == libssh2.STREAM_EXIT_STATUS:
+                my_print("execute exit status is %s" %data)
+            else:
                 my_print('Received data')
-                print data1[1]
-                data1 = self.chan.read_ex()        
+                print data
 
 
     def __del__(self):
@@ -21,17 +21,31 @@ __doc__ = """Python binding for libssh2 library"""
 
 from version import *
 
-from channel import ChannelException, Channel
-from session import SessionException, Session
-from sftp import SftpException, Sftp
+from _libssh2 import Error, TimeoutError
+
+from channel import STREAM_EXIT_STATUS, ChannelException, Channel
+from fleet import FleetResult, run_many
+from keepalive import Keepalive
+from session import SessionException, Session, SessionPool, PooledChannel
+from poller import POLLER_IN, POLLER_OUT, Poller
+from sftp import SftpDirEntry, SftpException, Sftp
 
 __all__ = [
     'Channel',
     'ChannelException',
+    'Error',
+    'FleetResult',
+    'Keepalive',
+    'Poller',
+    'PooledChannel',
     'Session',
     'SessionException',
+    'SessionPool',
     'Sftp',
-    'SftpException'
+    'SftpDirEntry',
+    'SftpException',
+    'TimeoutError',
+    'run_many'
 ]
 
 LIBSSH2_TRACE_TRANS = 1<<1
@@ -47,3 +61,7 @@ LIBSSH2_TRACE_SOCKET = 1<<9
 LIBSSH2_CALLBACK_X11 = 4
 
 LIBSSH2_ERROR_EAGAIN = -37
+
+LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL = 0
+LIBSSH2_CHANNEL_EXTENDED_DATA_IGNORE = 1
+LIBSSH2_CHANNEL_EXTENDED_DATA_MERGE = 2
@@ -0,0 +1,169 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Event loop support: drives non blocking L{Session} and L{Channel} calls
+from an asyncio compatible event loop (asyncio or its trollius backport).
+"""
+
+LIBSSH2_ERROR_EAGAIN = -37
+
+LIBSSH2_SESSION_BLOCK_INBOUND = 1
+LIBSSH2_SESSION_BLOCK_OUTBOUND = 2
+
+def _asyncio():
+    try:
+        import asyncio
+    except ImportError:
+        import trollius as asyncio
+    return asyncio
+
+def get_loop(loop=None):
+    """
+    Returns loop or the current event loop.
+    """
+    if loop is None:
+        loop = _asyncio().get_event_loop()
+    return loop
+
+def would_block(result):
+    """
+    Checks if a call returned LIBSSH2_ERROR_EAGAIN.
+    """
+    return isinstance(result, int) and result == LIBSSH2_ERROR_EAGAIN
+
+class Dispatcher(object):
+    """
+    Drives the pending operations of a session from an event loop.
+
+    The session socket is registered once with add_reader/add_writer in
+    the directions reported by blockdirections(), and every operation
+    waiting on it is retried when it becomes ready, so any number of
+    channels can share the session.
+    """
+    def __init__(self, session, loop):
+        """
+        Creates a dispatcher and puts session in non blocking mode.
+
+        @param session: session driven by the dispatcher
+        @type session: L{_libssh2.Session}
+        @param loop: event loop
+        @type loop: asyncio.AbstractEventLoop
+        """
+        self.session = session
+        self.loop = loop
+        self.pending = []
+        self.scheduled = False
+        self.reading = None
+        self.writing = None
+        session.setblocking(0)
+
+    def submit(self, call, args=(), blocked=would_block):
+        """
+        Runs call(*args) until blocked(result) is false.
+
+        @param call: non blocking operation
+        @type call: callable
+        @param args: arguments of call
+        @type args: tuple
+        @param blocked: predicate telling if the result means EAGAIN
+        @type blocked: callable
+
+        @return: future resolved with the final result of call
+        @rtype: asyncio.Future
+        """
+        if hasattr(self.loop, 'create_future'):
+            future = self.loop.create_future()
+        else:
+            future = _asyncio().Future(loop=self.loop)
+        self._step((future, call, args, blocked))
+        self._watch()
+        return future
+
+    def close(self):
+        """
+        Stops watching the session socket, once no operation is pending.
+
+        @return: None
+        """
+        if self.reading is not None:
+            self.loop.remove_reader(self.reading)
+            self.reading = None
+        if self.writing is not None:
+            self.loop.remove_writer(self.writing)
+            self.writing = None
+
+    def _step(self, operation):
+        future, call, args, blocked = operation
+        if future.done():
+            return False
+        try:
+            result = call(*args)
+        except Exception, e:
+            future.set_exception(e)
+            return True
+        if blocked(result):
+            self.pending.append(operation)
+            return False
+        future.set_result(result)
+        return True
+
+    def _ready(self):
+        self.scheduled = False
+        # A call may read packets meant for an operation already retried in
+        # the same pass, which would then wait for a socket event that never
+        # comes: retry until a whole pass, at least the second one, blocks.
+        passes = 0
+        progress = True
+        while self.pending and (progress or passes < 2):
+            pending, self.pending = self.pending, []
+            progress = False
+            for operation in pending:
+                if self._step(operation):
+                    progress = True
+            passes += 1
+        self._watch()
+
+    def _watch(self):
+        directions = 0
+        if self.pending:
+            directions = self.session.blockdirections()
+            if directions == 0 and not self.scheduled:
+                # not blocked on the socket any more, retry right away
+                self.scheduled = True
+                self.loop.call_soon(self._ready)
+        fd = None
+        if directions:
+            fd = self.session.fileno()
+
+        reading = fd if directions & LIBSSH2_SESSION_BLOCK_INBOUND else None
+        if reading != self.reading:
+            if self.reading is not None:
+                self.loop.remove_reader(self.reading)
+            if reading is not None:
+                self.loop.add_reader(reading, self._ready)
+            self.reading = reading
+
+        writing = fd if directions & LIBSSH2_SESSION_BLOCK_OUTBOUND else None
+        if writing != self.writing:
+            if self.writing is not None:
+                self.loop.remove_writer(self.writing)
+            if writing is not None:
+                self.loop.add_writer(writing, self._ready)
+            self.writing = writing
@@ -21,6 +21,11 @@
 Abstraction for libssh2 L{Channel} object
 """
 
+import aio
+
+# stream id of the exit status record ending L{Channel.exec_stream}
+STREAM_EXIT_STATUS = -1
+
 class ChannelException(Exception):
     """
     Exception raised when L{Channel} actions fails.
@@ -31,39 +36,87 @@ class Channel(object):
     """
     Channel object
     """
-    def __init__(self, _channel):
+    def __init__(self, _channel, session=None):
         """
         Creates a new channel object with the given _channel.
 
         @param _channel: low level channel object
         @type _channel: L{_libssh2.Channel}
+        @param session: session owning the channel, required by the
+                        event loop methods
+        @type session: L{Session}
         """
         self._channel = _channel
+        self._session = session
         self.closed = False
         self.flushed = False
 
-    def close(self):
+    def _submit(self, loop, call, *args):
+        """
+        Runs a non blocking call from the event loop of the session.
+        """
+        if self._session is None:
+            raise ChannelException("Channel has no session to wait on.")
+        return self._session._submit(loop, call, *args)
+
+    def close(self, timeout=None):
         """
         Closes the active channel.
 
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
+
         @return: 0 on success,
                  LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)
         @rtype: int
         """
         self.closed = True
-        return self._channel.close()
+        if timeout is None:
+            timeout = -1
+        return self._channel.close(timeout)
+
+    def close_async(self, loop=None):
+        """
+        Closes the channel from an event loop.
 
-    def wait_closed(self):
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.close)
+
+    def wait_closed(self, timeout=None):
         """
         Wait for remote channel to ack closing.
 
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
+
         @return: 0 on success,
                  LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode),
                  a negative value on failure
         @rtype: int
         """
         self.closed = True
-        return self._channel.wait_closed()
+        if timeout is None:
+            timeout = -1
+        return self._channel.wait_closed(timeout)
+
+    def wait_closed_async(self, loop=None):
+        """
+        Waits for remote channel to ack closing from an event loop.
+
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.wait_closed)
 
     def eof(self):
         """
@@ -74,19 +127,64 @@ class Channel(object):
         """
         return self._channel.eof()
 
-    def execute(self, command):
+    def execute(self, command, timeout=None):
         """
         Executes command on the channel.
 
         @param command: message data
         @type command: str
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
 
         @return: 0 on success,
                  LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)
         @rtype: int
         """
         self.closed = True
-        return self._channel.execute(command)
+        if timeout is None:
+            timeout = -1
+        return self._channel.execute(command, timeout)
+
+    def exec_stream(self, command, size=32768, timeout=None):
+        """
+        Executes command on the channel and iterates over its output as it
+        arrives, polling the session socket between chunks::
+
+            for stream_id, data in channel.exec_stream(command):
+                if stream_id == STREAM_EXIT_STATUS:
+                    exit_status = data
+
+        @param command: command to execute
+        @type command: str
+        @param size: maximum size of each chunk
+        @type size: int
+        @param timeout: maximum time in seconds to wait for output, None
+                        to wait forever
+        @type timeout: float
+
+        @return: iterator over (stream_id, data) tuples, 0 for stdout and
+                 1 for stderr, ended by (STREAM_EXIT_STATUS, exit_status)
+        @rtype: iterator
+        """
+        self.closed = True
+        if timeout is None:
+            timeout = -1
+        return self._channel.exec_stream(command, size, timeout)
+
+    def execute_async(self, command, loop=None):
+        """
+        Executes command on the channel from an event loop.
+
+        @param command: message data
+        @type command: str
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.execute, command)
 
     def exit_status(self):
         """
@@ -107,6 +205,19 @@ class Channel(object):
         self.flushed = True
         return self._channel.flush()
 
+    def handle_extended_data(self, mode):
+        """
+        Sets how extended data (stderr) is handled on the channel.
+
+        @param mode: value of libssh2.LIBSSH2_CHANNEL_EXTENDED_DATA_* constant
+        @type mode: int
+
+        @return: 0 on success,
+                 LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)
+        @rtype: int
+        """
+        return self._channel.handle_extended_data(mode)
+
     def poll_read(self, extended):
         """
         Checks if data is available on the channel.
@@ -150,48 +261,232 @@ class Channel(object):
         """
         return self._channel.pty_resize(width, height, pixelwidth, pixelheight)
 
-    def read(self, size=1024):
+    def read(self, size=1024, timeout=None):
         """
-        Reads size bytes on the channel.
+        Reads size bytes on the channel. With a negative size, the buffer is
+        sized from the bytes already queued on the channel and from the
+        previous reads on stdout.
 
-        @param size: size of the buffer storage
+        @param size: size of the buffer storage, -1 for automatic sizing
         @type size: int
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
 
         @return: bytes readed,
                  LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode),
                  None if EOF is encoutered
         @rtype: str or int or none
         """
-        return self._channel.read(size)
+        if timeout is None:
+            timeout = -1
+        return self._channel.read(size, timeout)
+
+    def read_async(self, size=1024, loop=None):
+        """
+        Reads size bytes on the channel from an event loop.
+
+        @param size: size of the buffer storage, -1 for automatic sizing
+        @type size: int
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with the bytes read, None at EOF
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.read, size)
 
-    def read_stderr(self, size=1024):
+    def read_stderr(self, size=1024, timeout=None):
         """
-        Reads size bytes on the channel stderr.
+        Reads size bytes on the channel stderr. With a negative size, the
+        buffer is sized from the bytes already queued on the channel and from
+        the previous reads on stderr.
 
-        @param size: size of the buffer storage
+        @param size: size of the buffer storage, -1 for automatic sizing
         @type size: int
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
 
         @return: bytes readed,
                  LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode),
                  None if EOF is encoutered
         @rtype: str or int or none
         """
-        return self._channel.read_stderr(size)
+        if timeout is None:
+            timeout = -1
+        return self._channel.read_stderr(size, timeout)
 
-    def read_ex(self, size=1024, stream_id=0):
+    def read_stderr_async(self, size=1024, loop=None):
         """
-        Reads size bytes on the channel with given stream_id.
+        Reads size bytes on the channel stderr from an event loop.
 
-        @param size: size of the buffer storage
+        @param size: size of the buffer storage, -1 for automatic sizing
+        @type size: int
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with the bytes read, None at EOF
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.read_stderr, size)
+
+    def read_ex(self, size=1024, stream_id=0, timeout=None):
+        """
+        Reads size bytes on the channel with given stream_id. With a negative
+        size, the buffer is sized from the bytes already queued on the
+        channel and from the previous reads on the stream.
+
+        @param size: size of the buffer storage, -1 for automatic sizing
         @type size: int
 
         @param stream_id: stream_id of the stream upon which to read
         @type size: int
 
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
+
         @return: bytes readed or negative on failure
         @rtype: str
         """
-        return self._channel.read_ex(size, stream_id)
+        if timeout is None:
+            timeout = -1
+        return self._channel.read_ex(size, stream_id, timeout)
+
+    def readinto(self, buffer, stream_id=0, timeout=None):
+        """
+        Reads bytes on the channel directly into a preallocated buffer.
+
+        @param buffer: writable storage reused across calls
+        @type buffer: bytearray, memoryview or mmap
+
+        @param stream_id: stream_id of the stream upon which to read
+        @type stream_id: int
+
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
+
+        @return: number of bytes stored in buffer,
+                 0 if EOF is encoutered,
+                 LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)
+        @rtype: int
+        """
+        if timeout is None:
+            timeout = -1
+        return self._channel.readinto(buffer, stream_id, timeout)
+
+    def read_all(self, max_bytes=-1, stream_id=0, timeout=None):
+        """
+        Reads the channel until EOF, or until max_bytes bytes have been
+        read, in a single call.
+
+        @param max_bytes: maximum number of bytes to read, -1 for no limit
+        @type max_bytes: int
+
+        @param stream_id: stream_id of the stream upon which to read
+        @type stream_id: int
+
+        @param timeout: maximum time in seconds each read may block, None
+                        for the session timeout
+        @type timeout: float
+
+        @return: bytes readed,
+                 LIBSSH2_ERROR_EAGAIN if it would block before any byte
+                 was read (non blocking mode)
+        @rtype: str or int
+        """
+        if timeout is None:
+            timeout = -1
+        return self._channel.read_all(max_bytes, stream_id, timeout)
+
+    def recv_into_fd(self, fd, stderr_fd=None, chunk_size=65536, timeout=None):
+        """
+        Reads the channel until EOF, writing data directly on local file
+        descriptors.
+
+        @param fd: local file descriptor or file object receiving stdout
+        @type fd: int or file
+        @param stderr_fd: local file descriptor or file object receiving
+                          stderr, None to leave stderr unread
+        @type stderr_fd: int or file or None
+        @param chunk_size: size of each channel read
+        @type chunk_size: int
+        @param timeout: maximum time in seconds each read may block, None
+                        for the session timeout
+        @type timeout: float
+
+        @return: number of bytes written from stdout and from stderr
+        @rtype: (int, int)
+        """
+        if timeout is None:
+            timeout = -1
+        return self._channel.recv_into_fd(fd, stderr_fd, chunk_size, timeout)
+
+    def read_streams(self, size=1024, timeout=None):
+        """
+        Reads size bytes on both stdout and stderr in a single pass.
+
+        @param size: maximum number of bytes to read on each stream
+        @type size: int
+        @param timeout: maximum time in seconds the call may block, None for
+                        the session timeout
+        @type timeout: float
+
+        @return: bytes readed on stdout and on stderr,
+                 LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode),
+                 None if EOF is encoutered on both streams
+        @rtype: (str, str) or int or None
+        """
+        if timeout is None:
+            timeout = -1
+        return self._channel.read_streams(size, timeout)
+
+    def makefile(self, stream_id=0, bufsize=32768):
+        """
+        Returns a buffered reader over a stream of the channel. The reader
+        provides read(), readline(), readuntil(delim) and iterates over
+        lines.
+
+        @param stream_id: stream_id of the stream upon which to read
+        @type stream_id: int
+        @param bufsize: initial size of the read buffer
+        @type bufsize: int
+
+        @return: new buffered reader
+        @rtype: L{_libssh2.ChannelFile}
+        """
+        return self._channel.makefile(stream_id, bufsize)
+
+    def iter_chunks(self, size=32768, stream_id=0, memoryview=False,
+                    pool_size=4):
+        """
+        Iterates over chunks of at most size bytes read on the channel until
+        EOF. Chunks are stored in a small pool of recycled buffers: a chunk
+        must be consumed, or copied, before the consumer keeps more than
+        pool_size - 1 of them alive, else new buffers are allocated.
+
+        @param size: maximum size of each chunk
+        @type size: int
+        @param stream_id: stream_id of the stream upon which to read
+        @type stream_id: int
+        @param memoryview: yield memoryviews instead of bytearrays
+        @type memoryview: bool
+        @param pool_size: number of recycled buffers
+        @type pool_size: int
+
+        @return: chunk iterator
+        @rtype: L{_libssh2.ChannelChunks}
+        """
+        return self._channel.iter_chunks(size, stream_id, int(memoryview),
+                                         pool_size)
+
+    def __iter__(self):
+        """
+        Iterates over the lines of the channel stdout.
+        """
+        return iter(self.makefile())
 
     def send_eof(self):
         """
@@ -202,6 +497,18 @@ class Channel(object):
         """
         self._channel.send_eof()
 
+    def send_eof_async(self, loop=None):
+        """
+        Sends EOF status on the channel from an event loop.
+
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self._channel.send_eof)
+
     def setblocking(self, mode=1):
         """
         Sets blocking mode on the channel. Default mode is blocking.
@@ -263,17 +570,112 @@ class Channel(object):
         """
         return self._channel.window_write()
 
-    def write(self, message):
+    def write(self, message, timeout=None):
         """
         Writes data on the channel.
 
         @param message: data to write
-        @type message: str
+        @type message: str or buffer
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
 
         @return: 0 on sucess or failure
         @rtype: int
         """
-        return self._channel.write(message)
+        if timeout is None:
+            timeout = -1
+        return self._channel.write(message, timeout)
+
+    def write_async(self, message, loop=None):
+        """
+        Writes all data on the channel from an event loop.
+
+        @param message: data to write
+        @type message: str or buffer
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with the number of bytes written
+        @rtype: asyncio.Future
+        """
+        data = memoryview(message)
+        sent = [0]
+        def write():
+            while sent[0] < len(data):
+                rc = self._channel.write(data[sent[0]:])
+                if rc < 0:
+                    if rc != aio.LIBSSH2_ERROR_EAGAIN:
+                        raise ChannelException(
+                            "Unable to write channel (error %d)." % rc
+                        )
+                    return rc
+                sent[0] += rc
+            return sent[0]
+        return self._submit(loop, write)
+
+    def writev(self, buffers, stream_id=0, timeout=None):
+        """
+        Writes a sequence of fragments on the channel as one stream, waiting
+        on the session socket in non blocking mode.
+
+        @param buffers: fragments to write
+        @type buffers: sequence of str or buffer
+
+        @param stream_id: stream_id of the stream upon which to write
+        @type stream_id: int
+        @param timeout: maximum time in seconds each write may block, None
+                        for the session timeout
+        @type timeout: float
+
+        @return: total number of bytes written
+        @rtype: int
+        """
+        if timeout is None:
+            timeout = -1
+        return self._channel.writev(buffers, stream_id, timeout)
+
+    def sendall(self, data, timeout=None):
+        """
+        Writes all data on the channel, continuing partial writes and
+        waiting on the session socket in non blocking mode.
+
+        @param data: data to write
+        @type data: str or buffer
+        @param timeout: maximum time in seconds each write may block, None
+                        for the session timeout
+        @type timeout: float
+
+        @return: number of bytes written
+        @rtype: int
+        """
+        if timeout is None:
+            timeout = -1
+        return self._channel.sendall(data, timeout)
+
+    def sendfile(self, fd, offset=0, count=None, timeout=None):
+        """
+        Streams a range of a local file on the channel without loading it
+        in memory.
+
+        @param fd: local file descriptor or file object
+        @type fd: int or file
+        @param offset: position of the first byte to send
+        @type offset: int
+        @param count: number of bytes to send, None to send up to end of file
+        @type count: int
+        @param timeout: maximum time in seconds each write may block, None
+                        for the session timeout
+        @type timeout: float
+
+        @return: number of bytes written
+        @rtype: int
+        """
+        if count is None:
+            count = -1
+        if timeout is None:
+            timeout = -1
+        return self._channel.sendfile(fd, offset, count, timeout)
 
     def x11_req(self, single_connection, auth_proto, auth_cookie, display):
         """
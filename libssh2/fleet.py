@@ -0,0 +1,54 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Runs one command over many hosts concurrently
+"""
+
+import _libssh2
+
+FleetResult = _libssh2.FleetResult
+
+def run_many(hosts, command, concurrency=16, timeout=None):
+    """
+    Runs command on every host from native worker threads. Connection,
+    authentication, execution and output collection run without the GIL,
+    so the wall-clock time is bound by the network rather than by Python.
+
+    @param hosts: (host, port, username, password) tuples, or
+                  (host, port, username, passphrase, privatekey) tuples
+                  for public key authentication
+    @type hosts: sequence
+    @param command: command to execute on each host
+    @type command: str
+    @param concurrency: number of hosts handled at the same time
+    @type concurrency: int
+    @param timeout: maximum time in seconds each blocking step may take,
+                    None to wait forever
+    @type timeout: float
+
+    @return: iterator yielding a L{FleetResult} per host as soon as it
+             completes, with host, port, exit_status, stdout, stderr,
+             error (None on success) and the connect_time, auth_time,
+             exec_time and total_time timings
+    @rtype: iterator
+    """
+    if timeout is None:
+        timeout = -1
+    return _libssh2.run_many(hosts, command, concurrency, timeout)
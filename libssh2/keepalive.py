@@ -0,0 +1,75 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Abstraction for libssh2 L{Keepalive} object
+"""
+
+import _libssh2
+
+class Keepalive(object):
+    """
+    Keepalive driver object, sending the keepalive messages of many
+    sessions from a single native background thread.
+    """
+    def __init__(self):
+        """
+        Creates a new keepalive driver and starts its thread.
+        """
+        self._keepalive = _libssh2.Keepalive()
+
+    def register(self, session, want_reply=False, interval=None):
+        """
+        Services the keepalive messages of a session, at the interval
+        libssh2 returns for it. Sessions busy in another thread are
+        skipped until they are idle again.
+
+        @param session: started session
+        @type session: L{Session}
+        @param want_reply: whether the server should answer keepalive
+                           messages, used with interval
+        @type want_reply: bool
+        @param interval: keepalive interval in seconds to configure on the
+                         session, None to keep its configuration
+        @type interval: int
+
+        @return: None
+        """
+        if interval is not None:
+            session.keepalive_config(want_reply, interval)
+        return self._keepalive.register(session._session)
+
+    def unregister(self, session):
+        """
+        Stops servicing the keepalive messages of a session.
+
+        @param session: registered session
+        @type session: L{Session}
+
+        @return: None
+        """
+        return self._keepalive.unregister(session._session)
+
+    def stop(self):
+        """
+        Stops the background thread and releases the registered sessions.
+
+        @return: None
+        """
+        return self._keepalive.stop()
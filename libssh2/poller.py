@@ -0,0 +1,82 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Abstraction for libssh2 L{Poller} object
+"""
+
+import _libssh2
+
+POLLER_IN = 1
+POLLER_OUT = 2
+
+class Poller(object):
+    """
+    Waits on many sessions and channels at once (Linux only).
+    """
+    def __init__(self):
+        """
+        Creates a new poller object.
+        """
+        self._poller = _libssh2.Poller()
+
+    def _raw(self, obj):
+        if hasattr(obj, '_channel'):
+            return obj._channel
+        return getattr(obj, '_session', obj)
+
+    def register(self, obj, events=POLLER_IN):
+        """
+        Watches a started session or a channel. Registering an object again
+        updates its events.
+
+        @param obj: session or channel to watch
+        @type obj: L{Session} or L{Channel}
+        @param events: mask of POLLER_IN and POLLER_OUT
+        @type events: int
+        """
+        self._poller.register(self._raw(obj), events, obj)
+
+    def unregister(self, obj):
+        """
+        Stops watching a session or a channel.
+
+        @param obj: session or channel registered
+        @type obj: L{Session} or L{Channel}
+        """
+        self._poller.unregister(self._raw(obj))
+
+    def poll(self, timeout=None):
+        """
+        Waits until some registered objects are ready. A session is ready
+        when its socket is ready in the directions libssh2 is blocked on
+        (retry the call which returned LIBSSH2_ERROR_EAGAIN), or right away
+        when libssh2 is not blocked, so sessions should be unregistered once
+        their call completed. A channel is ready when data or EOF is queued
+        on it (POLLER_IN) or when it can be written (POLLER_OUT).
+
+        @param timeout: maximum time to wait in seconds, None to wait forever
+        @type timeout: float
+
+        @return: ready objects with their events, empty on timeout
+        @rtype: list of (L{Session} or L{Channel}, int)
+        """
+        if timeout is None:
+            timeout = -1
+        return self._poller.poll(timeout)
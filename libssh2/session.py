@@ -21,9 +21,19 @@
 Abstraction for libssh2 L{Session} object
 """
 
+import select
+import socket
+import threading
+import time
+
 import _libssh2
 
+import aio
 from channel import Channel
+from keepalive import Keepalive
+
+# libssh2 error of a channel open refused by the server
+LIBSSH2_ERROR_CHANNEL_FAILURE = -21
 
 class SessionException(Exception):
     """
@@ -40,6 +50,27 @@ class Session(object):
         Create a new session object.
         """
         self._session = _libssh2.Session()
+        self._dispatcher = None
+
+    def _submit(self, loop, call, *args, **kwargs):
+        """
+        Runs a non blocking call from the event loop, see L{aio.Dispatcher}.
+        The session moves to another loop only once the operations of the
+        previous one are done, as their futures belong to it.
+        """
+        loop = aio.get_loop(loop)
+        dispatcher = self._dispatcher
+        if dispatcher is not None and dispatcher.loop is not loop:
+            if dispatcher.pending:
+                raise SessionException(
+                    "Session has operations pending on another event loop"
+                )
+            dispatcher.close()
+            dispatcher = None
+        if dispatcher is None:
+            dispatcher = aio.Dispatcher(self._session, loop)
+            self._dispatcher = dispatcher
+        return dispatcher.submit(call, args, **kwargs)
 
     def callback_set(self, callback_type, callback):
         """
@@ -64,6 +95,20 @@ class Session(object):
         """
         return self._session.close(reason)
 
+    def close_async(self, reason="Disconnect", loop=None):
+        """
+        Closes the session from an event loop.
+
+        @param reason: human readable reason for disconnection
+        @type reason: str
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.close, reason)
+
     def direct_tcpip(self, host, port, shost, sport):
         """
         Tunnels a TCP connection through the session.
@@ -77,10 +122,12 @@ class Session(object):
         @param sport: local port
         @type sport: int
 
-        @return: new opened L{Channel}
+        @return: new opened L{Channel} or None if it would block
+                 (non blocking mode)
         @rtype: L{Channel}
         """
-        return self._session.direct_tcpip(host, port, shost, sport)
+        ret = self._session.direct_tcpip(host, port, shost, sport)
+        return Channel(ret, self) if ret else None
 
     def forward_listen(self, host, port, bound_port, queue_maxsize):
         """
@@ -95,7 +142,8 @@ class Session(object):
         @param queue_maxsize: maxium number of pending connections
         @type int
 
-        @return: new L{Listener} instance on success or None on failure
+        @return: new L{Listener} instance or None if it would block
+                 (non blocking mode)
         @rtype: L{Listener}
         """
         return self._session.forward_listen(
@@ -123,15 +171,55 @@ class Session(object):
         """
         return self._session.last_error()
 
-    def open_session(self):
+    def open_session(self, extended_data=None):
         """
         Allocates a new L{Channel} for the session.
 
+        @param extended_data: value of libssh2.LIBSSH2_CHANNEL_EXTENDED_DATA_*
+                              constant applied to the new channel, None to
+                              keep stderr on its own stream
+        @type extended_data: int
+
         @return: new channel opened
         @rtype: L{Channel}
         """
         ret = self._session.open_session()
-        return Channel(ret) if ret else None
+        if ret and extended_data is not None:
+            # on a non blocking session the request may not be sent yet
+            while (ret.handle_extended_data(extended_data) ==
+                   aio.LIBSSH2_ERROR_EAGAIN):
+                self.wait()
+        return Channel(ret, self) if ret else None
+
+    def open_session_async(self, extended_data=None, loop=None):
+        """
+        Allocates a new L{Channel} for the session from an event loop.
+
+        @param extended_data: value of libssh2.LIBSSH2_CHANNEL_EXTENDED_DATA_*
+                              constant applied to the new channel, None to
+                              keep stderr on its own stream
+        @type extended_data: int
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with the new channel
+        @rtype: asyncio.Future
+        """
+        opened = []
+        def open_session():
+            # the channel is opened once, then the extended data request is
+            # retried on it until it goes through
+            if not opened:
+                ret = self._session.open_session()
+                if not ret:
+                    return aio.LIBSSH2_ERROR_EAGAIN
+                opened.append(ret)
+            if extended_data is not None:
+                rc = opened[0].handle_extended_data(extended_data)
+                if aio.would_block(rc):
+                    return rc
+            return Channel(opened[0], self)
+        return self._submit(loop, open_session)
 
     def set_trace(self, bitmask):
         """
@@ -149,10 +237,12 @@ class Session(object):
         @param remote_path: absolute path of remote file to transfer
         @type remote_path: str
 
-        @return: new channel opened
+        @return: new channel opened or None if it would block
+                 (non blocking mode)
         @rtype: L{Channel}
         """
-        return Channel(self._session.scp_recv(remote_path))
+        ret = self._session.scp_recv(remote_path)
+        return Channel(ret, self) if ret else None
 
     def scp_send(self, path, mode, size):
         """
@@ -165,10 +255,12 @@ class Session(object):
         @param size: size of file being transmitted
         @type size: int
 
-        @return: new channel opened
+        @return: new channel opened or None if it would block
+                 (non blocking mode)
         @rtype: L{Channel}
         """
-        return Channel(self._session.scp_send(path, mode, size))
+        ret = self._session.scp_send(path, mode, size)
+        return Channel(ret, self) if ret else None
 
     def session_method_pref(self, method_type, pref):
         """
@@ -236,6 +328,53 @@ class Session(object):
         """
         return self._session.getblocking()
 
+    def set_timeout(self, timeout):
+        """
+        Sets the maximum time blocking calls on the session may wait.
+        Calls which time out raise L{TimeoutError}.
+
+        @param timeout: timeout in seconds, 0 to wait forever
+        @type timeout: float
+
+        @return: None
+        """
+        return self._session.set_timeout(timeout)
+
+    def get_timeout(self):
+        """
+        Gets the maximum time blocking calls on the session may wait.
+
+        @return: timeout in seconds, 0 if calls wait forever
+        @rtype: float
+        """
+        return self._session.get_timeout()
+
+    def keepalive_config(self, want_reply, interval):
+        """
+        Configures the keepalive messages sent by L{keepalive_send}.
+
+        @param want_reply: whether the server should answer keepalive
+                           messages
+        @type want_reply: bool
+        @param interval: seconds of idle time before a keepalive message
+                         is due, 0 to disable keepalives
+        @type interval: int
+
+        @return: None
+        """
+        return self._session.keepalive_config(int(want_reply), interval)
+
+    def keepalive_send(self):
+        """
+        Sends a keepalive message if one is due.
+
+        @return: seconds until the next keepalive message is due,
+                 0 if keepalives are disabled,
+                 LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)
+        @rtype: int
+        """
+        return self._session.keepalive_send()
+
     def blockdirections(self):
         """
         Gets blocking mode on the session.
@@ -247,6 +386,32 @@ class Session(object):
         """
         return self._session.blockdirections()
 
+    def fileno(self):
+        """
+        Returns the descriptor of the socket the session was started up
+        with, so the session can be registered with select() or poll().
+
+        @return: socket descriptor
+        @rtype: int
+        """
+        return self._session.fileno()
+
+    def wait(self, timeout=None):
+        """
+        Waits until the socket is ready in the directions libssh2 is
+        blocked on, typically after a call returned LIBSSH2_ERROR_EAGAIN.
+        Returns immediately if libssh2 is not blocked.
+
+        @param timeout: maximum time to wait in seconds, None to wait forever
+        @type timeout: float
+
+        @return: 1 when the socket is ready, 0 on timeout
+        @rtype: int
+        """
+        if timeout is None:
+            timeout = -1
+        return self._session.wait(timeout)
+
     def startup(self, sock):
         """
         Starts up the session form a socket created by a socket.socket() call.
@@ -259,6 +424,21 @@ class Session(object):
         """
         return self._session.startup(sock)
 
+    def startup_async(self, sock, loop=None):
+        """
+        Starts up the session from an event loop. The session is switched
+        to non blocking mode.
+
+        @param sock: a connected socket object
+        @type sock: socket._socketobject
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.startup, sock)
+
     def userauth_authenticated(self):
         """
         Returns authentication status for the given session.
@@ -295,6 +475,22 @@ class Session(object):
         """
         return self._session.userauth_password(username, password)
 
+    def userauth_password_async(self, username, password, loop=None):
+        """
+        Authenticates a user with password from an event loop.
+
+        @param username: user to authenticate
+        @type username: str
+        @param password: password to use
+        @type password: str
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.userauth_password, username, password)
+
     def userauth_publickey_fromfile(
             self, username, publickey, privatekey, passphrase
         ):
@@ -317,6 +513,29 @@ class Session(object):
         return self._session.userauth_publickey_fromfile(username, publickey,
                                                          privatekey, passphrase)
 
+    def userauth_publickey_fromfile_async(
+            self, username, publickey, privatekey, passphrase, loop=None
+        ):
+        """
+        Authenticates a session with a key pair from an event loop.
+
+        @param username: user to authenticate
+        @type username: str
+        @param publickey: path and name of public key file
+        @type publickey: str
+        @param privatekey: path and name of private key file
+        @type privatekey: str
+        @param passphrase: passphrase to use when decoding private file
+        @type passphrase: str
+        @param loop: event loop, None for the current one
+        @type loop: asyncio.AbstractEventLoop
+
+        @return: future resolved with 0 on success
+        @rtype: asyncio.Future
+        """
+        return self._submit(loop, self.userauth_publickey_fromfile, username,
+                            publickey, privatekey, passphrase)
+
     def userauth_keyboardinteractive(self, username, password):
         """
         Authenticates a session with the given username using a
@@ -344,3 +563,406 @@ class Session(object):
         @rtype: int
         """
         return self._session.userauth_agent(username)
+
+
+class PooledChannel(Channel):
+    """
+    Channel opened by a L{SessionPool}, giving its slot back to the pool
+    once closed.
+    """
+    def __init__(self, _channel, session, pool, entry):
+        """
+        Creates a new pooled channel.
+
+        @param _channel: low level channel object
+        @type _channel: L{_libssh2.Channel}
+        @param session: pooled session owning the channel
+        @type session: L{Session}
+        @param pool: pool the session belongs to
+        @type pool: L{SessionPool}
+        @param entry: pool bookkeeping of the session
+        @type entry: L{_PoolEntry}
+        """
+        Channel.__init__(self, _channel, session)
+        self._pool = pool
+        self._entry = entry
+
+    def close(self, timeout=None):
+        """
+        Closes the channel and releases its slot in the pool.
+
+        @param timeout: maximum time in seconds the call may block, None
+                        for the session timeout
+        @type timeout: float
+
+        @return: 0 on success,
+                 LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)
+        @rtype: int
+        """
+        try:
+            return Channel.close(self, timeout)
+        finally:
+            self.release()
+
+    def release(self):
+        """
+        Releases the slot of the channel in the pool without closing it.
+        Calling it more than once has no effect.
+
+        @return: None
+        """
+        entry, self._entry = self._entry, None
+        if entry is not None:
+            self._pool._release(entry)
+
+
+class _PoolEntry(object):
+    """
+    Pool bookkeeping of an authenticated session.
+    """
+    def __init__(self, key, session, sock):
+        self.key = key
+        self.session = session
+        self.sock = sock
+        self.channels = 0
+        self.last_used = time.time()
+        # removed from the pool, closed once its last channel is released
+        self.discarded = False
+
+
+class SessionPool(object):
+    """
+    Pool of authenticated sessions keyed by host, port and user.
+
+    Channels are opened on pooled sessions, sharing each connection
+    between up to max_channels channels and threads, so that a short
+    command costs one channel round trip instead of a connect, a key
+    exchange and an authentication. Pooled sessions are kept warm by a
+    native L{Keepalive} driver, checked for a connection closed by the
+    server before reuse, and closed once idle for idle_timeout seconds,
+    down to min_sessions per key. Idle sessions are evicted whenever a
+    channel is opened or released, see L{evict_idle}.
+    """
+    def __init__(self, max_sessions=4, max_channels=8, min_sessions=0,
+                 idle_timeout=300, keepalive_interval=30, timeout=None):
+        """
+        Creates a new session pool.
+
+        @param max_sessions: maximum number of sessions per key
+        @type max_sessions: int
+        @param max_channels: maximum number of open channels per session
+        @type max_channels: int
+        @param min_sessions: number of sessions connected as soon as a key
+                             is registered and kept when idle
+        @type min_sessions: int
+        @param idle_timeout: seconds after which an unused session is
+                             closed, None to keep sessions forever
+        @type idle_timeout: float
+        @param keepalive_interval: seconds between keepalive messages,
+                                   0 to disable keepalives
+        @type keepalive_interval: int
+        @param timeout: maximum time in seconds for connections and
+                        blocking calls of pooled sessions, None for none
+        @type timeout: float
+        """
+        if max_sessions < 1 or max_channels < 1:
+            raise ValueError("max_sessions and max_channels must be positive")
+        self.max_sessions = max_sessions
+        self.max_channels = max_channels
+        self.min_sessions = min(min_sessions, max_sessions)
+        self.idle_timeout = idle_timeout
+        self.keepalive_interval = keepalive_interval
+        self.timeout = timeout
+        self._credentials = {}
+        self._entries = {}
+        self._connecting = {}
+        self._cond = threading.Condition()
+        self._keepalive = None
+        if keepalive_interval:
+            self._keepalive = Keepalive()
+
+    def register(self, host, port, username, password=None, publickey=None,
+                 privatekey=None, passphrase=""):
+        """
+        Registers the credentials of a host and user, and connects the
+        first min_sessions sessions.
+
+        @param host: remote host
+        @type host: str
+        @param port: remote port
+        @type port: int
+        @param username: user to authenticate
+        @type username: str
+        @param password: password, when no private key is given
+        @type password: str
+        @param publickey: path and name of public key file
+        @type publickey: str
+        @param privatekey: path and name of private key file
+        @type privatekey: str
+        @param passphrase: passphrase of the private key file
+        @type passphrase: str
+
+        @return: None
+        """
+        key = (host, port, username)
+        with self._cond:
+            self._credentials[key] = (password, publickey, privatekey,
+                                      passphrase)
+            self._entries.setdefault(key, [])
+            self._connecting.setdefault(key, 0)
+        # one reservation at a time, so that a failed connection leaves no
+        # reservation behind
+        while True:
+            with self._cond:
+                if (len(self._entries[key]) + self._connecting[key] >=
+                        self.min_sessions):
+                    return
+                self._connecting[key] += 1
+            self._add(key, self._connect(key))
+
+    def open_session(self, host, port, username, extended_data=None,
+                     wait=None):
+        """
+        Opens a channel on a pooled session, connecting a new session when
+        all of them are busy and max_sessions is not reached. Otherwise
+        waits for a channel to be released.
+
+        @param host: remote host
+        @type host: str
+        @param port: remote port
+        @type port: int
+        @param username: user of a registered key
+        @type username: str
+        @param extended_data: value of libssh2.LIBSSH2_CHANNEL_EXTENDED_DATA_*
+                              constant applied to the new channel
+        @type extended_data: int
+        @param wait: maximum time in seconds to wait for a free slot, None
+                     to wait forever
+        @type wait: float
+
+        @return: new channel, releasing its slot once closed
+        @rtype: L{PooledChannel}
+        """
+        key = (host, port, username)
+        for retry in (True, False):
+            entry = self._acquire(key, wait)
+            try:
+                ret = entry.session._session.open_session()
+                if ret is None:
+                    raise SessionException("Failed to open channel")
+                if extended_data is not None:
+                    ret.handle_extended_data(extended_data)
+                return PooledChannel(ret, entry.session, self, entry)
+            except Exception, e:
+                if not self._broken(entry, e):
+                    # refused by the server, the session is still usable
+                    self._release(entry)
+                    raise
+                # drop the session and retry once on another one
+                self._discard(entry)
+                if not retry:
+                    raise
+
+    def evict_idle(self):
+        """
+        Closes the sessions unused for idle_timeout seconds, keeping
+        min_sessions sessions per key.
+
+        @return: number of sessions closed
+        @rtype: int
+        """
+        if self.idle_timeout is None:
+            return 0
+        evicted = []
+        deadline = time.time() - self.idle_timeout
+        with self._cond:
+            for key, entries in self._entries.items():
+                for entry in list(entries):
+                    if len(entries) <= self.min_sessions:
+                        break
+                    if entry.channels == 0 and entry.last_used < deadline:
+                        entries.remove(entry)
+                        evicted.append(entry)
+        for entry in evicted:
+            self._close(entry)
+        return len(evicted)
+
+    def sessions(self, host, port, username):
+        """
+        Returns the number of pooled sessions of a key.
+
+        @return: number of connected sessions
+        @rtype: int
+        """
+        with self._cond:
+            return len(self._entries.get((host, port, username), ()))
+
+    def close(self):
+        """
+        Closes every pooled session and stops the keepalive driver.
+
+        @return: None
+        """
+        with self._cond:
+            entries = [e for es in self._entries.values() for e in es]
+            for key in self._entries:
+                self._entries[key] = []
+            self._cond.notify_all()
+        for entry in entries:
+            self._close(entry)
+        if self._keepalive is not None:
+            self._keepalive.stop()
+
+    def _connect(self, key):
+        """
+        Connects and authenticates a new session. Called without the pool
+        lock, with the connection already counted in _connecting.
+        """
+        host, port, username = key
+        password, publickey, privatekey, passphrase = self._credentials[key]
+        try:
+            sock = socket.create_connection((host, port), self.timeout)
+            sock.settimeout(None)
+            session = Session()
+            if self.timeout is not None:
+                session.set_timeout(self.timeout)
+            try:
+                session.startup(sock)
+                if privatekey is not None:
+                    session.userauth_publickey_fromfile(
+                        username, publickey, privatekey, passphrase
+                    )
+                else:
+                    session.userauth_password(username, password)
+            except Exception:
+                sock.close()
+                raise
+        except Exception:
+            with self._cond:
+                self._connecting[key] -= 1
+                self._cond.notify_all()
+            raise
+        if self._keepalive is not None:
+            self._keepalive.register(session, True, self.keepalive_interval)
+        return _PoolEntry(key, session, sock)
+
+    def _add(self, key, entry):
+        """
+        Adds a connected session to the pool.
+        """
+        with self._cond:
+            self._connecting[key] -= 1
+            self._entries[key].append(entry)
+            self._cond.notify_all()
+
+    def _connected(self, entry):
+        """
+        Checks without a round trip that the server did not close the
+        connection of an idle session. Other failures show up when the
+        channel is opened, see L{_broken}.
+        """
+        try:
+            readable = select.select([entry.sock], [], [], 0)[0]
+            return not readable or entry.sock.recv(1, socket.MSG_PEEK) != ""
+        except (select.error, socket.error):
+            return False
+
+    def _broken(self, entry, error):
+        """
+        Checks whether a failed channel open left its session unusable,
+        rather than being refused by the server. The error code is the one
+        captured by the failed call, last_error() may already report the
+        call of another thread sharing the session.
+        """
+        if isinstance(error, SessionException):
+            return True
+        code = getattr(error, "code", None)
+        if not isinstance(error, _libssh2.Error) or code is None:
+            return False
+        return code < 0 and code != LIBSSH2_ERROR_CHANNEL_FAILURE
+
+    def _acquire(self, key, wait):
+        """
+        Reserves a channel slot on the least loaded session of a key.
+        """
+        if key not in self._credentials:
+            raise SessionException("No credentials registered for %s:%d as %s"
+                                   % key)
+        deadline = None if wait is None else time.time() + wait
+        self.evict_idle()
+        while True:
+            with self._cond:
+                entries = self._entries[key]
+                free = [e for e in entries if e.channels < self.max_channels]
+                if free:
+                    entry = min(free, key=lambda e: e.channels)
+                    entry.channels += 1
+                    entry.last_used = time.time()
+                elif len(entries) + self._connecting[key] < self.max_sessions:
+                    self._connecting[key] += 1
+                    entry = None
+                else:
+                    remaining = None
+                    if deadline is not None:
+                        remaining = deadline - time.time()
+                        if remaining <= 0:
+                            raise SessionException(
+                                "No pooled session available for %s:%d as %s"
+                                % key
+                            )
+                    self._cond.wait(remaining)
+                    continue
+            if entry is None:
+                entry = self._connect(key)
+                entry.channels = 1
+                self._add(key, entry)
+                return entry
+            if entry.channels > 1 or self._connected(entry):
+                return entry
+            self._discard(entry)
+
+    def _release(self, entry):
+        """
+        Gives a channel slot back to the pool, closing a discarded session
+        once its last channel is released.
+        """
+        with self._cond:
+            entry.channels -= 1
+            entry.last_used = time.time()
+            close = entry.discarded and entry.channels == 0
+            self._cond.notify_all()
+        if close:
+            self._close(entry)
+        self.evict_idle()
+
+    def _discard(self, entry):
+        """
+        Removes a broken session from the pool and gives back the slot of
+        the caller. Channels other threads still have open on the session
+        keep it alive until they are released.
+        """
+        with self._cond:
+            entries = self._entries.get(entry.key, [])
+            if entry in entries:
+                entries.remove(entry)
+            entry.discarded = True
+            entry.channels -= 1
+            close = entry.channels == 0
+            self._cond.notify_all()
+        if close:
+            self._close(entry)
+
+    def _close(self, entry):
+        """
+        Disconnects a session removed from the pool.
+        """
+        if self._keepalive is not None:
+            try:
+                self._keepalive.unregister(entry.session)
+            except KeyError:
+                pass
+        try:
+            entry.session.close()
+        except Exception:
+            pass
+        entry.sock.close()
@@ -21,6 +21,10 @@
 Abstraction for libssh2 L{Sftp} object
 """
 
+import _libssh2
+
+SftpDirEntry = _libssh2.SftpDirEntry
+
 class SftpException(Exception):
     """
     Exception raised when L{Sftp} actions fails.
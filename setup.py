@@ -74,10 +74,27 @@ class Libssh2TestCommand(Command):
 
     def run(self):
         import unittest
-        from test_session import SessionTest
+        from test_session import SessionTest, SessionLoopTest, \
+            SessionWaitTest, SessionNonblockingTest, SessionThreadTest, \
+            SessionKeepaliveTest, SessionTimeoutTest, SessionPoolTest
+        from test_channel import ChannelTest
+        from test_fleet import FleetTest
+        from test_poller import PollerTest
+        from test_sftp import SftpTest
 
         suite = unittest.TestSuite()
         suite.addTest(unittest.makeSuite(SessionTest))
+        suite.addTest(unittest.makeSuite(SessionLoopTest))
+        suite.addTest(unittest.makeSuite(SessionWaitTest))
+        suite.addTest(unittest.makeSuite(SessionNonblockingTest))
+        suite.addTest(unittest.makeSuite(SessionThreadTest))
+        suite.addTest(unittest.makeSuite(SessionKeepaliveTest))
+        suite.addTest(unittest.makeSuite(SessionTimeoutTest))
+        suite.addTest(unittest.makeSuite(SessionPoolTest))
+        suite.addTest(unittest.makeSuite(ChannelTest))
+        suite.addTest(unittest.makeSuite(PollerTest))
+        suite.addTest(unittest.makeSuite(FleetTest))
+        suite.addTest(unittest.makeSuite(SftpTest))
 
         runner = unittest.TextTestRunner()
         runner.run(suite)
@@ -19,19 +19,157 @@
  * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 #include <Python.h>
+#include <errno.h>
+#include <unistd.h>
 #define PYLIBSSH2_MODULE
 #include "pylibssh2.h"
 
+/* {{{ channel_socket_fd
+ *
+ * Returns the socket descriptor of the parent session or -1 if unknown.
+ */
+int
+channel_socket_fd(PYLIBSSH2_CHANNEL *self)
+{
+    if (self->session == NULL) {
+        return -1;
+    }
+
+    return self->session->fd;
+}
+/* }}} */
+
+/* {{{ channel_write_all
+ *
+ * Writes len bytes of buf on the given stream, continuing partial writes.
+ * When fd is a valid descriptor, LIBSSH2_ERROR_EAGAIN is handled by
+ * waiting on the session socket up to the session timeout, otherwise it
+ * stops the loop. The number
+ * of accepted bytes is added to *written. Must be called without the GIL.
+ */
+static int
+channel_write_all(PYLIBSSH2_CHANNEL *self, int stream_id, int fd,
+                  const char *buf, size_t len, Py_ssize_t *written)
+{
+    int rc = 0;
+    size_t sent = 0;
+
+    while (sent < len) {
+        rc = libssh2_channel_write_ex(self->channel, stream_id, buf + sent,
+                                      len - sent);
+        if (rc >= 0) {
+            sent += rc;
+        }
+        else if (rc != LIBSSH2_ERROR_EAGAIN || fd < 0 ||
+                 (rc = wait_session(self->session->session, fd)) < 0) {
+            break;
+        }
+    }
+    *written += sent;
+
+    return rc < 0 ? rc : 0;
+}
+/* }}} */
+
+/* bounds of the buffer size picked by auto-sized reads */
+#define AUTO_READ_MIN_SIZE 1024
+#define AUTO_READ_MAX_SIZE 1048576
+
+/* read_hint slot of a stream: 0 for stdout, 1 for stderr and the other
+   extended data streams */
+#define AUTO_READ_HINT(stream_id) ((stream_id) == 0 ? 0 : 1)
+
+/* {{{ channel_auto_read_size
+ *
+ * Picks the buffer size of an auto-sized read: the bytes already queued on
+ * the channel or the running average of previous reads, whichever is the
+ * largest, bounded by the initial read window.
+ */
+static int
+channel_auto_read_size(PYLIBSSH2_CHANNEL *self, int stream_id)
+{
+    unsigned long read_avail = 0;
+    unsigned long window_size_initial = 0;
+    unsigned long size;
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    libssh2_channel_window_read_ex(self->channel, &read_avail,
+                                   &window_size_initial);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    size = self->read_hint[AUTO_READ_HINT(stream_id)];
+    if (read_avail > size)
+        size = read_avail;
+    if (window_size_initial > 0 && size > window_size_initial)
+        size = window_size_initial;
+    if (size < AUTO_READ_MIN_SIZE)
+        size = AUTO_READ_MIN_SIZE;
+    if (size > AUTO_READ_MAX_SIZE)
+        size = AUTO_READ_MAX_SIZE;
+
+    return (int)size;
+}
+/* }}} */
+
+/* {{{ channel_auto_read_update
+ *
+ * Feeds the result of an auto-sized read into the running average. A read
+ * that filled its buffer doubles the estimate, so bulk streams quickly
+ * reach large reads while chatty ones settle on small buffers.
+ */
+static void
+channel_auto_read_update(PYLIBSSH2_CHANNEL *self, int stream_id, int size,
+                         int rc)
+{
+    unsigned long hint;
+    unsigned long *slot = &self->read_hint[AUTO_READ_HINT(stream_id)];
+
+    if (rc <= 0)
+        return;
+
+    if (rc == size)
+        hint = (unsigned long)size * 2;
+    else
+        hint = (*slot * 3 + rc) / 4;
+
+    if (hint < AUTO_READ_MIN_SIZE)
+        hint = AUTO_READ_MIN_SIZE;
+    if (hint > AUTO_READ_MAX_SIZE)
+        hint = AUTO_READ_MAX_SIZE;
+    *slot = hint;
+}
+/* }}} */
+
+/* {{{ channel_eof
+ *
+ * libssh2_channel_eof() walks the session packet queue, so it runs under
+ * the session lock as well.
+ */
+static int
+channel_eof(PYLIBSSH2_CHANNEL *self)
+{
+    int eof;
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    eof = libssh2_channel_eof(self->channel);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    return eof;
+}
+/* }}} */
 
 /* {{{ PYLIBSSH2_Channel_close
  */
 static char PYLIBSSH2_Channel_close_doc[] = "\n\
-close() -> int\n\
+close([timeout]) -> int\n\
 \n\
 Closes the active channel.\n\
 \n\
 @param channel\n\
 @type libssh2.Channel\n\
+@param timeout: maximum time in seconds the call may block, negative\n\
+       for the session timeout\n\
+@type timeout: float\n\
 \n\
 @return 0 on success or LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)\n\
 @rtype int";
@@ -40,12 +178,25 @@ static PyObject *
 PYLIBSSH2_Channel_close(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "|d:close", &timeout))
+        return NULL;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
     rc = libssh2_channel_close(self->channel);
-    if (rc != LIBSSH2_ERROR_EAGAIN)
+    /* a channel closed before the remote EOF is already fully closed,
+       wait_closed would fail with LIBSSH2_ERROR_INVAL */
+    if (rc == 0 && libssh2_channel_eof(self->channel))
         rc = libssh2_channel_wait_closed(self->channel);
-    Py_END_ALLOW_THREADS
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc && rc != LIBSSH2_ERROR_EAGAIN) {
         /* CLEAN: PYLIBSSH2_CHANNEL_CANT_CLOSE_MSG */
@@ -96,10 +247,10 @@ PYLIBSSH2_Channel_pty(PYLIBSSH2_CHANNEL *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_request_pty_ex(self->channel, term, term_len, modes, modes_len,
                                         width, height, width_px, height_px);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc && rc != LIBSSH2_ERROR_EAGAIN) {
         /* CLEAN: PYLIBSSH2_CHANNEL_PTY_FAILED_MSG */ 
@@ -151,10 +302,10 @@ PYLIBSSH2_Channel_pty_resize(PYLIBSSH2_CHANNEL *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_request_pty_size_ex(self->channel, width, height,
                                                 width_px, height_px);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc && rc != LIBSSH2_ERROR_EAGAIN) {
         PyErr_Format(PYLIBSSH2_Error, "Failed to resize pty (error %d).", rc);
@@ -180,9 +331,9 @@ PYLIBSSH2_Channel_shell(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_shell(self->channel);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc && rc != LIBSSH2_ERROR_EAGAIN) {
         /* CLEAN: PYLIBSSH2_CHANNEL_CANT_REQUEST_SHELL_MSG */
@@ -197,12 +348,15 @@ PYLIBSSH2_Channel_shell(PYLIBSSH2_CHANNEL *self, PyObject *args)
 /* {{{ PYLIBSSH2_Channel_execute
  */
 static char PYLIBSSH2_Channel_execute_doc[] = "\n\
-execute(command) -> int\n\
+execute(command, [timeout]) -> int\n\
 \n\
 Executes command on the channel.\n\
 \n\
 @param  command: message data\n\
 @type   command: str\n\
+@param  timeout: maximum time in seconds the call may block, negative\n\
+        for the session timeout\n\
+@type   timeout: float\n\
 \n\
 @return 0 on success or LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)\n\
 @rtype  int";
@@ -213,13 +367,21 @@ PYLIBSSH2_Channel_execute(PYLIBSSH2_CHANNEL *self, PyObject *args)
     int rc;
     /* command to execute */
     char *command;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "s:execute", &command))
+    if (!PyArg_ParseTuple(args, "s|d:execute", &command, &timeout))
         return NULL;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
     rc = libssh2_channel_exec(self->channel, command);
-    Py_END_ALLOW_THREADS
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc && rc != LIBSSH2_ERROR_EAGAIN) {
         /* CLEAN: PYLIBSSH2_CANT_REQUEST_EXEC_COMMAND_MSG */
@@ -258,9 +420,9 @@ PYLIBSSH2_Channel_setenv(PYLIBSSH2_CHANNEL *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "ss:setenv", &env_key, &env_val))
         return NULL;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_setenv(self->channel, env_key, env_val);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc == -1) {
         /* CLEAN: PYLIBSSH2_CANT_SET_ENVRIONNEMENT_VARIABLE_MSG */
@@ -272,6 +434,47 @@ PYLIBSSH2_Channel_setenv(PYLIBSSH2_CHANNEL *self, PyObject *args)
 }
 /* }}} */
 
+/* {{{ PYLIBSSH2_Channel_handle_extended_data
+ */
+static char PYLIBSSH2_Channel_handle_extended_data_doc[] = "\n\
+handle_extended_data(mode) -> int\n\
+\n\
+Sets how extended data (stderr) is handled on the channel.\n\
+\n\
+@param  mode: CHANNEL_EXTENDED_DATA_NORMAL to queue it on its own stream,\n\
+              CHANNEL_EXTENDED_DATA_IGNORE to discard it or\n\
+              CHANNEL_EXTENDED_DATA_MERGE to merge it with stdout\n\
+@type   mode: int\n\
+\n\
+@return 0 on success or LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Channel_handle_extended_data(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc;
+    int mode;
+
+    if (!PyArg_ParseTuple(args, "i:handle_extended_data", &mode))
+        return NULL;
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    rc = libssh2_channel_handle_extended_data2(self->channel, mode);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (rc == 0) {
+        self->extended_data = mode;
+    }
+
+    if (rc && rc != LIBSSH2_ERROR_EAGAIN) {
+        PyErr_Format(PYLIBSSH2_Error, "Unable to set extended data mode (error %d).", rc);
+        return NULL;
+    }
+
+    return Py_BuildValue("i", rc);
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Channel_setblocking
  */
 static char PYLIBSSH2_Channel_setblocking_doc[] = "\n\
@@ -291,7 +494,9 @@ PYLIBSSH2_Channel_setblocking(PYLIBSSH2_CHANNEL *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "i:setblocking", &block))
         return NULL;
 
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     libssh2_channel_set_blocking(self->channel, block);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -301,12 +506,16 @@ PYLIBSSH2_Channel_setblocking(PYLIBSSH2_CHANNEL *self, PyObject *args)
 /* {{{ PYLIBSSH2_Channel_read
  */
 static char PYLIBSSH2_Channel_read_doc[] = "\n\
-read(size) -> str\n\
+read(size, [timeout]) -> str\n\
 \n\
-Reads size bytes on the channel.\n\
+Reads size bytes on the channel. When size is negative, the buffer is\n\
+sized from the bytes already queued and the previous reads on the stream.\n\
 \n\
-@param size: size of the buffer storage\n\
+@param size: size of the buffer storage, -1 for automatic sizing\n\
 @type  size: int\n\
+@param timeout: maximum time in seconds the call may block, negative\n\
+       for the session timeout\n\
+@type  timeout: float\n\
 \n\
 @return string containing bytes read or negative value on failure\n\
         LIBSSH2_ERROR_EAGAIN if it would block\n\
@@ -317,36 +526,51 @@ static PyObject *
 PYLIBSSH2_Channel_read(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
-    int buffer_size;
+    int buffer_size = -1;
+    int auto_size;
     /* buffer to read as a python object */
     PyObject *buffer;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "i|i:read", &buffer_size))
+    if (!PyArg_ParseTuple(args, "i|d:read", &buffer_size, &timeout))
         return NULL;
 
-    buffer = PyString_FromStringAndSize(NULL, buffer_size);
-    if (buffer == NULL) {
-        return NULL;
-    }
+    if (channel_eof(self) != 1) {
+        auto_size = buffer_size < 0;
+        if (auto_size)
+            buffer_size = channel_auto_read_size(self, 0);
+
+        buffer = PyString_FromStringAndSize(NULL, buffer_size);
+        if (buffer == NULL) {
+            return NULL;
+        }
 
-    if (libssh2_channel_eof(self->channel) != 1) {
-        Py_BEGIN_ALLOW_THREADS
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+        saved = session_timeout_begin(self->session, timeout);
         rc = libssh2_channel_read(self->channel, PyString_AsString(buffer),
                                   buffer_size);
-        Py_END_ALLOW_THREADS
+        session_timeout_end(self->session, saved);
+        PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+        if (auto_size)
+            channel_auto_read_update(self, 0, buffer_size, rc);
 
         if (rc > 0) {
             if (rc != buffer_size && _PyString_Resize(&buffer, rc) < 0)
                 return NULL;
             return buffer;
         }
-        else if (rc == LIBSSH2_ERROR_EAGAIN) {
-            Py_XDECREF(buffer);
+
+        Py_DECREF(buffer);
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
             return Py_BuildValue("i", rc);
         }
+        if (rc == LIBSSH2_ERROR_TIMEOUT) {
+            return session_timeout_error();
+        }
     }
 
-    Py_XDECREF(buffer);
     Py_INCREF(Py_None);
 
     return Py_None;
@@ -356,12 +580,16 @@ PYLIBSSH2_Channel_read(PYLIBSSH2_CHANNEL *self, PyObject *args)
 /* {{{ PYLIBSSH2_Channel_read_stderr
  */
 static char PYLIBSSH2_Channel_read_stderr_doc[] = "\n\
-read_stderr(size) -> str\n\
+read_stderr(size, [timeout]) -> str\n\
 \n\
-Reads size bytes on the channel stderr.\n\
+Reads size bytes on the channel stderr. When size is negative, the buffer is\n\
+sized from the bytes already queued and the previous reads on the stream.\n\
 \n\
-@param size: size of the buffer storage\n\
+@param size: size of the buffer storage, -1 for automatic sizing\n\
 @type  size: int\n\
+@param timeout: maximum time in seconds the call may block, negative\n\
+       for the session timeout\n\
+@type  timeout: float\n\
 \n\
 @return string containing bytes read or negative value on failure\n\
         LIBSSH2_ERROR_EAGAIN if it would block\n\
@@ -372,36 +600,51 @@ static PyObject *
 PYLIBSSH2_Channel_read_stderr(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
-    int buffer_size;
+    int buffer_size = -1;
+    int auto_size;
     /* buffer to read as a python object */
     PyObject *buffer;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "i|i:read_stderr", &buffer_size))
+    if (!PyArg_ParseTuple(args, "i|d:read_stderr", &buffer_size, &timeout))
         return NULL;
 
-    buffer = PyString_FromStringAndSize(NULL, buffer_size);
-    if (buffer == NULL) {
-        return NULL;
-    }
+    if (channel_eof(self) != 1) {
+        auto_size = buffer_size < 0;
+        if (auto_size)
+            buffer_size = channel_auto_read_size(self, 1);
 
-    if (libssh2_channel_eof(self->channel) != 1) {
-        Py_BEGIN_ALLOW_THREADS
+        buffer = PyString_FromStringAndSize(NULL, buffer_size);
+        if (buffer == NULL) {
+            return NULL;
+        }
+
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+        saved = session_timeout_begin(self->session, timeout);
         rc = libssh2_channel_read_stderr(self->channel, PyString_AsString(buffer),
                                   buffer_size);
-        Py_END_ALLOW_THREADS
+        session_timeout_end(self->session, saved);
+        PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+        if (auto_size)
+            channel_auto_read_update(self, 1, buffer_size, rc);
 
         if (rc > 0) {
             if (rc != buffer_size && _PyString_Resize(&buffer, rc) < 0)
                 return NULL;
             return buffer;
         }
-        else if (rc == LIBSSH2_ERROR_EAGAIN) {
-            Py_XDECREF(buffer);
+
+        Py_DECREF(buffer);
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
             return Py_BuildValue("i", rc);
         }
+        if (rc == LIBSSH2_ERROR_TIMEOUT) {
+            return session_timeout_error();
+        }
     }
 
-    Py_XDECREF(buffer);
     Py_INCREF(Py_None);
 
     return Py_None;
@@ -411,14 +654,18 @@ PYLIBSSH2_Channel_read_stderr(PYLIBSSH2_CHANNEL *self, PyObject *args)
 /* {{{ PYLIBSSH2_Channel_read_ex
  */
 static char PYLIBSSH2_Channel_read_ex_doc[] = "\n\
-read(size, [stream_id]) -> str\n\
+read_ex(size, [stream_id, timeout]) -> str\n\
 \n\
-Reads size bytes on the channel.\n\
+Reads size bytes on the channel. When size is negative, the buffer is\n\
+sized from the bytes already queued and the previous reads on the stream.\n\
 \n\
-@param size: size of the buffer storage\n\
+@param size: size of the buffer storage, -1 for automatic sizing\n\
 @type  size: int\n\
 @param stream_id: substream ID number\n\
 @type  stream_id: int\n\
+@param timeout: maximum time in seconds the call may block, negative\n\
+       for the session timeout\n\
+@type  timeout: float\n\
 \n\
 @return string containing bytes read or negative value on failure\n\
 @rtype  str or int";
@@ -427,28 +674,50 @@ static PyObject *
 PYLIBSSH2_Channel_read_ex(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
-    int buffer_size;
+    int buffer_size = -1;
+    int auto_size;
     int stream_id = 0;
     /* buffer to read as a python object */
     PyObject *buffer;
     char * cbuf;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "i|i:read_ex", &buffer_size, &stream_id))
+    if (!PyArg_ParseTuple(args, "i|id:read_ex", &buffer_size, &stream_id,
+                          &timeout))
         return NULL;
+
+    /* nothing to read: libssh2 would block on a zero sized buffer */
+    if (buffer_size == 0)
+        return Py_BuildValue("is", 0, "");
+
+    auto_size = buffer_size < 0;
+    if (auto_size)
+        buffer_size = channel_auto_read_size(self, stream_id);
+
     buffer = PyString_FromStringAndSize(NULL, buffer_size);
     if (buffer == NULL) {
         return NULL;
     }
     cbuf = PyString_AsString(buffer);
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
     rc = libssh2_channel_read_ex(self->channel, stream_id, cbuf, buffer_size);
-    Py_END_ALLOW_THREADS
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
-    if (rc > 0) {
-       if (rc != buffer_size && _PyString_Resize(&buffer, rc) < 0)
-            return NULL;
+    if (auto_size)
+        channel_auto_read_update(self, stream_id, buffer_size, rc);
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        Py_DECREF(buffer);
+        return session_timeout_error();
     }
+
+    /* never hand out the unfilled part of the buffer */
+    if (rc != buffer_size && _PyString_Resize(&buffer, rc > 0 ? rc : 0) < 0)
+        return NULL;
     /**
        we do NOT increment the reference on the buffer anymore
        it is already done by PyString_FromStringAndSize
@@ -457,15 +726,564 @@ PYLIBSSH2_Channel_read_ex(PYLIBSSH2_CHANNEL *self, PyObject *args)
 }
 /* }}} */
 
+/* {{{ PYLIBSSH2_Channel_readinto
+ */
+static char PYLIBSSH2_Channel_readinto_doc[] = "\n\
+readinto(buffer, [stream_id, timeout]) -> int\n\
+\n\
+Reads bytes on the channel directly into a writable buffer.\n\
+\n\
+@param buffer: preallocated storage (bytearray, memoryview, mmap...)\n\
+@type  buffer: writable buffer\n\
+@param stream_id: substream ID number\n\
+@type  stream_id: int\n\
+@param timeout: maximum time in seconds the call may block, negative\n\
+       for the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return number of bytes stored in buffer, 0 if EOF is encountered or\n\
+        LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Channel_readinto(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc;
+    int stream_id = 0;
+    /* caller-owned storage, filled in place */
+    Py_buffer buffer;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "w*|id:readinto", &buffer, &stream_id,
+                          &timeout))
+        return NULL;
+
+    if (buffer.len == 0 || channel_eof(self) == 1) {
+        PyBuffer_Release(&buffer);
+        return Py_BuildValue("i", 0);
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    rc = libssh2_channel_read_ex(self->channel, stream_id, buffer.buf,
+                                 buffer.len);
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    PyBuffer_Release(&buffer);
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        /* CLEAN: PYLIBSSH2_CANT_READ_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read channel (error %d).", rc);
+        return NULL;
+    }
+
+    return Py_BuildValue("i", rc);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_read_all
+ */
+static char PYLIBSSH2_Channel_read_all_doc[] = "\n\
+read_all([max_bytes, stream_id, timeout]) -> str\n\
+\n\
+Reads the channel until EOF or until max_bytes bytes have been read.\n\
+The whole drain runs without the GIL.\n\
+\n\
+@param max_bytes: maximum number of bytes to read, -1 for no limit\n\
+@type  max_bytes: int\n\
+@param stream_id: substream ID number\n\
+@type  stream_id: int\n\
+@param timeout: maximum time in seconds each read may block, negative\n\
+       for the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return string containing bytes read or LIBSSH2_ERROR_EAGAIN if it would\n\
+        block before any byte was read (non blocking mode)\n\
+@rtype  str or int";
+
+/* initial size of the read_all buffer, doubled each time it fills up */
+#define READ_ALL_CHUNK_SIZE 32768
+
+static PyObject *
+PYLIBSSH2_Channel_read_all(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc = 0;
+    int stream_id = 0;
+    Py_ssize_t max_bytes = -1;
+    /* storage grown outside of the GIL, copied once into the result */
+    char *data, *grown;
+    size_t data_len = 0;
+    size_t data_size = READ_ALL_CHUNK_SIZE;
+    size_t new_size;
+    PyObject *result;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "|nid:read_all", &max_bytes, &stream_id,
+                          &timeout))
+        return NULL;
+
+    if (max_bytes >= 0 && (size_t)max_bytes < data_size) {
+        data_size = max_bytes > 0 ? max_bytes : 1;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    data = malloc(data_size);
+    while (data != NULL) {
+        if (max_bytes >= 0 && data_len >= (size_t)max_bytes)
+            break;
+
+        if (data_len == data_size) {
+            new_size = data_size * 2;
+            if (max_bytes >= 0 && new_size > (size_t)max_bytes)
+                new_size = max_bytes;
+            grown = realloc(data, new_size);
+            if (grown == NULL) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            data_size = new_size;
+        }
+
+        rc = libssh2_channel_read_ex(self->channel, stream_id,
+                                     data + data_len, data_size - data_len);
+        if (rc <= 0)
+            break;
+        data_len += rc;
+    }
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (data == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        free(data);
+        return session_timeout_error();
+    }
+
+    if (rc < 0 && (rc != LIBSSH2_ERROR_EAGAIN || data_len == 0)) {
+        free(data);
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            return Py_BuildValue("i", rc);
+        }
+        /* CLEAN: PYLIBSSH2_CANT_READ_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read channel (error %d).", rc);
+        return NULL;
+    }
+
+    result = PyString_FromStringAndSize(data, data_len);
+    free(data);
+
+    return result;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_recv_into_fd
+ */
+static char PYLIBSSH2_Channel_recv_into_fd_doc[] = "\n\
+recv_into_fd(fd, [stderr_fd, chunk_size, timeout]) -> (int, int)\n\
+\n\
+Reads the channel until EOF and writes the data directly on local file\n\
+descriptors, with the GIL released for the whole transfer. When stderr_fd\n\
+is given the stderr stream is pumped in the same pass.\n\
+\n\
+@param  fd: local file descriptor or file object receiving stdout\n\
+@type   fd: int or file\n\
+@param  stderr_fd: local file descriptor or file object receiving stderr\n\
+@type   stderr_fd: int or file or None\n\
+@param  chunk_size: size of each channel read\n\
+@type   chunk_size: int\n\
+@param  timeout: maximum time in seconds each read may block, negative\n\
+        for the session timeout\n\
+@type   timeout: float\n\
+\n\
+@return number of bytes written from stdout and from stderr\n\
+@rtype  (int, int)";
+
+static PyObject *
+PYLIBSSH2_Channel_recv_into_fd(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc = 0;
+    int i;
+    int sock;
+    int blocking = 1;
+    int streams = 1;
+    int done, progress;
+    int write_errno = 0;
+    int fds[2] = { -1, -1 };
+    Py_ssize_t counts[2] = { 0, 0 };
+    Py_ssize_t chunk_size = 65536;
+    PyObject *file;
+    PyObject *err_file = Py_None;
+    char *chunk;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "O|Ond:recv_into_fd", &file, &err_file,
+                          &chunk_size, &timeout))
+        return NULL;
+
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size must be positive");
+        return NULL;
+    }
+
+    fds[0] = PyObject_AsFileDescriptor(file);
+    if (fds[0] < 0) {
+        return NULL;
+    }
+    if (err_file != Py_None) {
+        fds[1] = PyObject_AsFileDescriptor(err_file);
+        if (fds[1] < 0) {
+            return NULL;
+        }
+        streams = 2;
+    }
+
+    chunk = PyMem_Malloc(chunk_size);
+    if (chunk == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    sock = channel_socket_fd(self);
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    /*
+     * With the socket at hand, reads never block inside libssh2: a stream
+     * with nothing queued cannot hold back the other one and we sleep in
+     * poll() until the transport has something for us.
+     */
+    saved = session_timeout_begin(self->session, timeout);
+    if (sock >= 0) {
+        blocking = libssh2_session_get_blocking(self->session->session);
+        libssh2_session_set_blocking(self->session->session, 0);
+    }
+    while (1) {
+        done = 0;
+        progress = 0;
+        for (i = 0; i < streams; i++) {
+            rc = libssh2_channel_read_ex(self->channel, i, chunk, chunk_size);
+            if (rc > 0) {
+                if (write_all(fds[i], chunk, rc) < 0) {
+                    write_errno = errno;
+                    break;
+                }
+                counts[i] += rc;
+                progress = 1;
+            }
+            else if (rc == 0) {
+                done++;
+            }
+            else if (rc != LIBSSH2_ERROR_EAGAIN) {
+                break;
+            }
+        }
+        if (i < streams || done == streams) {
+            break;
+        }
+        if (!progress && (sock < 0 ||
+                (rc = wait_session(self->session->session, sock)) < 0)) {
+            break;
+        }
+    }
+    if (sock >= 0) {
+        libssh2_session_set_blocking(self->session->session, blocking);
+    }
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    PyMem_Free(chunk);
+
+    if (write_errno) {
+        errno = write_errno;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        /* CLEAN: PYLIBSSH2_CANT_READ_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read channel (error %d).", rc);
+        return NULL;
+    }
+
+    return Py_BuildValue("(nn)", counts[0], counts[1]);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_read_streams
+ */
+static char PYLIBSSH2_Channel_read_streams_doc[] = "\n\
+read_streams(size, [timeout]) -> (str, str)\n\
+\n\
+Reads up to size bytes on both stdout and stderr in a single pass.\n\
+Whichever stream has data is returned without waiting on the other one.\n\
+Stderr is not read when it is ignored or merged with stdout.\n\
+\n\
+@param size: maximum number of bytes to read on each stream\n\
+@type  size: int\n\
+@param timeout: maximum time in seconds the call may block, negative for\n\
+        the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return tuple of bytes read on stdout and on stderr, at least one of them\n\
+        not empty, LIBSSH2_ERROR_EAGAIN if it would block (non blocking\n\
+        mode) or None if EOF is encoutered on both streams\n\
+@rtype  (str, str) or int or None";
+
+static PyObject *
+PYLIBSSH2_Channel_read_streams(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc[2] = { 0, 0 };
+    int i;
+    int streams = 2;
+    int size;
+    int sock;
+    int blocking = 1;
+    char *chunk;
+    PyObject *result;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "i|d:read_streams", &size, &timeout))
+        return NULL;
+
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive");
+        return NULL;
+    }
+
+    chunk = PyMem_Malloc(2 * (size_t)size);
+    if (chunk == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    if (self->extended_data != LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL) {
+        streams = 1;
+    }
+
+    sock = channel_socket_fd(self);
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    /* see recv_into_fd(): never let a quiet stream block the other one */
+    if (sock >= 0) {
+        blocking = libssh2_session_get_blocking(self->session->session);
+        libssh2_session_set_blocking(self->session->session, 0);
+    }
+    while (1) {
+        for (i = 0; i < streams; i++) {
+            rc[i] = libssh2_channel_read_ex(self->channel, i,
+                                            chunk + i * size, size);
+        }
+        if (rc[0] > 0 || rc[1] > 0) {
+            break;
+        }
+        if (rc[0] != LIBSSH2_ERROR_EAGAIN && rc[1] != LIBSSH2_ERROR_EAGAIN) {
+            break;
+        }
+        if ((rc[0] < 0 && rc[0] != LIBSSH2_ERROR_EAGAIN) ||
+            (rc[1] < 0 && rc[1] != LIBSSH2_ERROR_EAGAIN)) {
+            break;
+        }
+        if (sock < 0 || !blocking) {
+            break;
+        }
+        rc[0] = wait_session(self->session->session, sock);
+        if (rc[0] < 0) {
+            break;
+        }
+    }
+    if (sock >= 0) {
+        libssh2_session_set_blocking(self->session->session, blocking);
+    }
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    for (i = 0; i < 2; i++) {
+        if (rc[i] == LIBSSH2_ERROR_TIMEOUT) {
+            PyMem_Free(chunk);
+            return session_timeout_error();
+        }
+        if (rc[i] < 0 && rc[i] != LIBSSH2_ERROR_EAGAIN) {
+            PyMem_Free(chunk);
+            /* CLEAN: PYLIBSSH2_CANT_READ_CHANNEL_MSG */
+            PyErr_Format(PYLIBSSH2_Error, "Unable to read channel (error %d).",
+                         rc[i]);
+            return NULL;
+        }
+    }
+
+    if (rc[0] > 0 || rc[1] > 0) {
+        result = Py_BuildValue("(s#s#)", chunk, rc[0] > 0 ? rc[0] : 0,
+                               chunk + size, rc[1] > 0 ? rc[1] : 0);
+    }
+    else if (rc[0] == LIBSSH2_ERROR_EAGAIN || rc[1] == LIBSSH2_ERROR_EAGAIN) {
+        result = Py_BuildValue("i", LIBSSH2_ERROR_EAGAIN);
+    }
+    else {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+    PyMem_Free(chunk);
+
+    return result;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_makefile
+ */
+static char PYLIBSSH2_Channel_makefile_doc[] = "\n\
+makefile([stream_id, bufsize]) -> libssh2.ChannelFile\n\
+\n\
+Returns a buffered reader over a stream of the channel, providing read(),\n\
+readline(), readuntil() and iteration over lines.\n\
+\n\
+@param stream_id: substream ID number\n\
+@type  stream_id: int\n\
+@param bufsize: initial size of the read buffer\n\
+@type  bufsize: int\n\
+\n\
+@return new buffered reader\n\
+@rtype  libssh2.ChannelFile";
+
+static PyObject *
+PYLIBSSH2_Channel_makefile(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int stream_id = 0;
+    Py_ssize_t bufsize = 32768;
+
+    if (!PyArg_ParseTuple(args, "|in:makefile", &stream_id, &bufsize))
+        return NULL;
+
+    if (bufsize <= 0) {
+        PyErr_SetString(PyExc_ValueError, "bufsize must be positive");
+        return NULL;
+    }
+
+    return (PyObject *)PYLIBSSH2_ChannelFile_New(self, stream_id, bufsize);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_iter_chunks
+ */
+static char PYLIBSSH2_Channel_iter_chunks_doc[] = "\n\
+iter_chunks([size, stream_id, memoryview, pool_size]) -> libssh2.ChannelChunks\n\
+\n\
+Returns an iterator over chunks of at most size bytes read on a stream of\n\
+the channel. Chunks are bytearrays taken from a pool of pool_size buffers\n\
+recycled once the consumer no longer references them; with memoryview set,\n\
+memoryviews over the pooled buffers are yielded instead.\n\
+\n\
+@param size: maximum size of each chunk\n\
+@type  size: int\n\
+@param stream_id: substream ID number\n\
+@type  stream_id: int\n\
+@param memoryview: yield memoryviews instead of bytearrays\n\
+@type  memoryview: int\n\
+@param pool_size: number of recycled buffers\n\
+@type  pool_size: int\n\
+\n\
+@return new chunk iterator\n\
+@rtype  libssh2.ChannelChunks";
+
+static PyObject *
+PYLIBSSH2_Channel_iter_chunks(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    Py_ssize_t size = 32768;
+    int stream_id = 0;
+    int as_memoryview = 0;
+    int pool_size = 4;
+
+    if (!PyArg_ParseTuple(args, "|niii:iter_chunks", &size, &stream_id,
+                          &as_memoryview, &pool_size))
+        return NULL;
+
+    if (size <= 0 || size > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive");
+        return NULL;
+    }
+    if (pool_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "pool_size must be positive");
+        return NULL;
+    }
+
+    return (PyObject *)PYLIBSSH2_ChannelChunks_New(self, stream_id, size,
+                                                   as_memoryview, pool_size);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_exec_stream
+ */
+static char PYLIBSSH2_Channel_exec_stream_doc[] = "\n\
+exec_stream(command, [size, timeout]) -> libssh2.ChannelStream\n\
+\n\
+Executes command on the channel and returns an iterator over its output.\n\
+Each item is a (stream_id, data) tuple, 0 for stdout and 1 for stderr,\n\
+yielded as soon as data arrives on either stream. Once the remote side has\n\
+closed the channel, a last (STREAM_EXIT_STATUS, exit_status) record is\n\
+yielded. The session socket is polled between chunks, in blocking and\n\
+non blocking mode alike.\n\
+\n\
+@param  command: command to execute\n\
+@type   command: str\n\
+@param  size: maximum size of each chunk\n\
+@type   size: int\n\
+@param  timeout: maximum time in seconds to wait for output, negative to\n\
+        wait forever\n\
+@type   timeout: float\n\
+\n\
+@return new output iterator\n\
+@rtype  libssh2.ChannelStream";
+
+static PyObject *
+PYLIBSSH2_Channel_exec_stream(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    char *command;
+    int size = 32768;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "s|id:exec_stream", &command, &size, &timeout))
+        return NULL;
+
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive");
+        return NULL;
+    }
+    if (self->session == NULL) {
+        PyErr_SetString(PYLIBSSH2_Error, "Channel has no session.");
+        return NULL;
+    }
+
+    return (PyObject *)PYLIBSSH2_ChannelStream_New(self, command, size, timeout);
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Channel_write
  */
 static char PYLIBSSH2_Channel_write_doc[] = "\n\
-write(message) -> int\n\
+write(message, [timeout]) -> int\n\
 \n\
 Writes data on a channel.\n\
 \n\
 @param  message: data to write\n\
-@type   message: str\n\
+@type   message: str or buffer\n\
+@param  timeout: maximum time in seconds the call may block, negative\n\
+        for the session timeout\n\
+@type   timeout: float\n\
 \n\
 @return 0 on success or failure\n\
 @rtype  int";
@@ -474,15 +1292,24 @@ static PyObject *
 PYLIBSSH2_Channel_write(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
-    char *message;
-    int message_len;
+    Py_buffer message;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "s#:write", &message, &message_len))
+    if (!PyArg_ParseTuple(args, "s*|d:write", &message, &timeout))
         return NULL;
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_channel_write(self->channel, message, message_len);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    rc = libssh2_channel_write(self->channel, message.buf, message.len);
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    PyBuffer_Release(&message);
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc == -1) {
         /* CLEAN: PYLIBSSH2_CANT_WRITE_CHANNEL_MSG */
@@ -494,6 +1321,316 @@ PYLIBSSH2_Channel_write(PYLIBSSH2_CHANNEL *self, PyObject *args)
 }
 /* }}} */
 
+/* {{{ PYLIBSSH2_Channel_sendall
+ */
+static char PYLIBSSH2_Channel_sendall_doc[] = "\n\
+sendall(data, [timeout]) -> int\n\
+\n\
+Writes all data on the channel. Partial writes are continued and, in non\n\
+blocking mode, the session socket is waited on in the directions reported\n\
+by libssh2 until every byte is accepted.\n\
+\n\
+@param  data: data to write\n\
+@type   data: str or buffer\n\
+@param  timeout: maximum time in seconds each write may block, negative\n\
+        for the session timeout\n\
+@type   timeout: float\n\
+\n\
+@return number of bytes written\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Channel_sendall(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc;
+    int fd;
+    Py_buffer data;
+    Py_ssize_t sent = 0;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "s*|d:sendall", &data, &timeout))
+        return NULL;
+
+    fd = channel_socket_fd(self);
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    rc = channel_write_all(self, 0, fd, data.buf, data.len, &sent);
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    PyBuffer_Release(&data);
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        /* CLEAN: PYLIBSSH2_CANT_WRITE_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to write channel (error %d).", rc);
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_EAGAIN && sent == 0) {
+        return Py_BuildValue("i", rc);
+    }
+
+    return Py_BuildValue("n", sent);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_writev
+ */
+static char PYLIBSSH2_Channel_writev_doc[] = "\n\
+writev(buffers, [stream_id, timeout]) -> int\n\
+\n\
+Writes a sequence of fragments on the channel as one stream. Small\n\
+fragments are coalesced into packet sized writes. In non blocking mode\n\
+the session socket is waited on until every fragment is accepted.\n\
+\n\
+@param  buffers: fragments to write\n\
+@type   buffers: sequence of str or buffer\n\
+@param  stream_id: substream ID number\n\
+@type   stream_id: int\n\
+@param  timeout: maximum time in seconds each write may block, negative\n\
+        for the session timeout\n\
+@type   timeout: float\n\
+\n\
+@return total number of bytes written\n\
+@rtype  int";
+
+/* fragments smaller than this are gathered in one staging buffer */
+#define WRITEV_COALESCE_SIZE 32768
+
+static PyObject *
+PYLIBSSH2_Channel_writev(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc = 0;
+    int sock;
+    int stream_id = 0;
+    long saved;
+    double timeout = -1;
+    PyObject *buffers;
+    PyObject *seq;
+    Py_buffer *views;
+    Py_ssize_t i, count;
+    Py_ssize_t total = 0;
+    Py_ssize_t written = 0;
+    /* staging buffer for small fragments */
+    char *stage;
+    size_t stage_len = 0;
+
+    if (!PyArg_ParseTuple(args, "O|id:writev", &buffers, &stream_id,
+                          &timeout))
+        return NULL;
+
+    seq = PySequence_Fast(buffers, "writev() argument must be a sequence");
+    if (seq == NULL) {
+        return NULL;
+    }
+    count = PySequence_Fast_GET_SIZE(seq);
+
+    views = PyMem_New(Py_buffer, count > 0 ? count : 1);
+    stage = PyMem_Malloc(WRITEV_COALESCE_SIZE);
+    if (views == NULL || stage == NULL) {
+        PyMem_Free(views);
+        PyMem_Free(stage);
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    for (i = 0; i < count; i++) {
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, i), &views[i],
+                               PyBUF_SIMPLE) < 0) {
+            while (--i >= 0) {
+                PyBuffer_Release(&views[i]);
+            }
+            PyMem_Free(views);
+            PyMem_Free(stage);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        total += views[i].len;
+    }
+
+    sock = channel_socket_fd(self);
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    for (i = 0; i < count && rc == 0; i++) {
+        if ((size_t)views[i].len < WRITEV_COALESCE_SIZE - stage_len) {
+            memcpy(stage + stage_len, views[i].buf, views[i].len);
+            stage_len += views[i].len;
+            continue;
+        }
+        if (stage_len > 0) {
+            rc = channel_write_all(self, stream_id, sock, stage, stage_len,
+                                   &written);
+            stage_len = 0;
+            if (rc < 0)
+                break;
+        }
+        if (views[i].len < WRITEV_COALESCE_SIZE) {
+            memcpy(stage, views[i].buf, views[i].len);
+            stage_len = views[i].len;
+        }
+        else {
+            rc = channel_write_all(self, stream_id, sock, views[i].buf,
+                                   views[i].len, &written);
+        }
+    }
+    if (rc == 0 && stage_len > 0) {
+        rc = channel_write_all(self, stream_id, sock, stage, stage_len,
+                               &written);
+    }
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    for (i = 0; i < count; i++) {
+        PyBuffer_Release(&views[i]);
+    }
+    PyMem_Free(views);
+    PyMem_Free(stage);
+    Py_DECREF(seq);
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        /* CLEAN: PYLIBSSH2_CANT_WRITE_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to write channel (error %d).", rc);
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_EAGAIN && written == 0 && total > 0) {
+        return Py_BuildValue("i", rc);
+    }
+
+    return Py_BuildValue("n", written);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Channel_sendfile
+ */
+static char PYLIBSSH2_Channel_sendfile_doc[] = "\n\
+sendfile(fd, [offset, count, timeout]) -> int\n\
+\n\
+Streams count bytes of a local file, starting at offset, on the channel.\n\
+The file is read in large chunks with pread() and written without the\n\
+GIL, using constant memory. In non blocking mode the session socket is\n\
+waited on until the whole range is accepted.\n\
+\n\
+@param  fd: local file descriptor or file object\n\
+@type   fd: int or file\n\
+@param  offset: position of the first byte to send\n\
+@type   offset: int\n\
+@param  count: number of bytes to send, -1 to send up to end of file\n\
+@type   count: int\n\
+@param  timeout: maximum time in seconds each write may block, negative\n\
+        for the session timeout\n\
+@type   timeout: float\n\
+\n\
+@return number of bytes written\n\
+@rtype  int";
+
+/* size of the pread() chunks pushed through the channel */
+#define SENDFILE_CHUNK_SIZE 262144
+
+static PyObject *
+PYLIBSSH2_Channel_sendfile(PYLIBSSH2_CHANNEL *self, PyObject *args)
+{
+    int rc = 0;
+    int fd;
+    int sock;
+    int read_errno = 0;
+    PyObject *file;
+    PY_LONG_LONG offset = 0;
+    PY_LONG_LONG count = -1;
+    Py_ssize_t sent = 0;
+    Py_ssize_t chunk_sent;
+    ssize_t n;
+    size_t want;
+    char *chunk;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "O|LLd:sendfile", &file, &offset, &count,
+                          &timeout))
+        return NULL;
+
+    fd = PyObject_AsFileDescriptor(file);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (offset < 0) {
+        PyErr_SetString(PyExc_ValueError, "negative offset");
+        return NULL;
+    }
+
+    chunk = PyMem_Malloc(SENDFILE_CHUNK_SIZE);
+    if (chunk == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    sock = channel_socket_fd(self);
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    while (count != 0) {
+        want = SENDFILE_CHUNK_SIZE;
+        if (count > 0 && (PY_LONG_LONG)want > count)
+            want = count;
+
+        n = pread(fd, chunk, want, offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            read_errno = errno;
+            break;
+        }
+        if (n == 0)
+            break;
+
+        chunk_sent = 0;
+        rc = channel_write_all(self, 0, sock, chunk, n, &chunk_sent);
+        sent += chunk_sent;
+        offset += chunk_sent;
+        if (rc < 0)
+            break;
+        if (count > 0)
+            count -= n;
+    }
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    PyMem_Free(chunk);
+
+    if (read_errno) {
+        errno = read_errno;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        /* CLEAN: PYLIBSSH2_CANT_WRITE_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to write channel (error %d).", rc);
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_EAGAIN && sent == 0) {
+        return Py_BuildValue("i", rc);
+    }
+
+    return Py_BuildValue("n", sent);
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Channel_flush
  */
 static char PYLIBSSH2_Channel_flush_doc[] = "\n\
@@ -509,9 +1646,9 @@ PYLIBSSH2_Channel_flush(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_flush(self->channel);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc == -1) {
         /* CLEAN: PYLIBSSH2_CANT_FLUSH_CHANNEL_MSG */
@@ -553,7 +1690,7 @@ Checks if the remote host has sent an EOF status.\n\
 static PyObject *
 PYLIBSSH2_Channel_eof(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
-    return Py_BuildValue("i", libssh2_channel_eof(self->channel));
+    return Py_BuildValue("i", channel_eof(self));
 }
 /* }}} */
 
@@ -572,9 +1709,9 @@ PYLIBSSH2_Channel_send_eof(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_send_eof(self->channel);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc == -1) {
         /* CLEAN: PYLIBSSH2_CANT_SEND_EOF_MSG */
@@ -589,12 +1726,15 @@ PYLIBSSH2_Channel_send_eof(PYLIBSSH2_CHANNEL *self, PyObject *args)
 /* {{{ PYLIBSSH2_Channel_wait_closed
  */
 static char PYLIBSSH2_Channel_wait_closed_doc[] = "\n\
-wait_closed() -> int\n\
+wait_closed([timeout]) -> int\n\
 \n\
 Wait for the remote channel to ack channel close.\n\
 \n\
 @param channel\n\
 @type libssh2.Channel\n\
+@param timeout: maximum time in seconds the call may block, negative\n\
+       for the session timeout\n\
+@type timeout: float\n\
 \n\
 @return 0 on success or negative on failure\n\
 @rtype int";
@@ -603,10 +1743,21 @@ static PyObject *
 PYLIBSSH2_Channel_wait_closed(PYLIBSSH2_CHANNEL *self, PyObject *args)
 {
     int rc;
+    long saved;
+    double timeout = -1;
 
-    Py_BEGIN_ALLOW_THREADS
+    if (!PyArg_ParseTuple(args, "|d:wait_closed", &timeout))
+        return NULL;
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
     rc = libssh2_channel_wait_closed(self->channel);
-    Py_END_ALLOW_THREADS
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     return Py_BuildValue("i", rc);
 }
@@ -632,9 +1783,9 @@ PYLIBSSH2_Channel_window_read(PYLIBSSH2_CHANNEL *self, PyObject *args)
     unsigned long read_avail;
     unsigned long window_size_initial;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_window_read_ex(self->channel, &read_avail, &window_size_initial);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     return Py_BuildValue("(kkk)", rc, read_avail, window_size_initial);
 }
@@ -657,9 +1808,9 @@ PYLIBSSH2_Channel_window_write(PYLIBSSH2_CHANNEL *self)
     unsigned long rc=0;
     unsigned long window_size_initial;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_window_write_ex(self->channel, &window_size_initial);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     return Py_BuildValue("(kk)", rc, window_size_initial);
 }
@@ -697,9 +1848,9 @@ PYLIBSSH2_Channel_x11_req(PYLIBSSH2_CHANNEL *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_x11_req_ex(self->channel, single_connection, auth_proto, auth_cookie, display);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     return Py_BuildValue("i", rc);
 }
@@ -728,9 +1879,9 @@ PYLIBSSH2_Channel_poll_read(PYLIBSSH2_CHANNEL *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_poll_channel_read(self->channel, extended);
-    Py_END_ALLOW_THREADS;
+    PYLIBSSH2_END_ALLOW_THREADS(self->session);
 
     return Py_BuildValue("i", rc);
 }
@@ -752,12 +1903,23 @@ static PyMethodDef PYLIBSSH2_Channel_methods[] =
     ADD_METHOD(pty_resize),
     ADD_METHOD(shell),
     ADD_METHOD(execute),
+    ADD_METHOD(exec_stream),
     ADD_METHOD(setenv),
     ADD_METHOD(setblocking),
+    ADD_METHOD(handle_extended_data),
     ADD_METHOD(read_ex),
     ADD_METHOD(read),
     ADD_METHOD(read_stderr),
+    ADD_METHOD(readinto),
+    ADD_METHOD(read_all),
+    ADD_METHOD(recv_into_fd),
+    ADD_METHOD(read_streams),
+    ADD_METHOD(makefile),
+    ADD_METHOD(iter_chunks),
     ADD_METHOD(write),
+    ADD_METHOD(sendall),
+    ADD_METHOD(writev),
+    ADD_METHOD(sendfile),
     ADD_METHOD(flush),
     ADD_METHOD(eof),
     ADD_METHOD(exit_status),
@@ -775,7 +1937,8 @@ static PyMethodDef PYLIBSSH2_Channel_methods[] =
 /* {{{ PYLIBSSH2_Channel_New
  */
 PYLIBSSH2_CHANNEL *
-PYLIBSSH2_Channel_New(LIBSSH2_CHANNEL *channel, int dealloc)
+PYLIBSSH2_Channel_New(LIBSSH2_CHANNEL *channel, PYLIBSSH2_SESSION *session,
+                      int dealloc)
 {
     PYLIBSSH2_CHANNEL *self;
 
@@ -786,6 +1949,12 @@ PYLIBSSH2_Channel_New(LIBSSH2_CHANNEL *channel, int dealloc)
 
     self->channel = channel;
     self->dealloc = dealloc;
+    self->extended_data = LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL;
+    self->read_hint[0] = AUTO_READ_MIN_SIZE;
+    self->read_hint[1] = AUTO_READ_MIN_SIZE;
+
+    Py_XINCREF(session);
+    self->session = session;
 
     return self;
 }
@@ -796,6 +1965,9 @@ PYLIBSSH2_Channel_New(LIBSSH2_CHANNEL *channel, int dealloc)
 static void
 PYLIBSSH2_Channel_dealloc(PYLIBSSH2_CHANNEL *self)
 {
+    Py_XDECREF(self->session);
+    self->session = NULL;
+
     PyObject_Del(self);
 }
 /* }}} */
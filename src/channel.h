@@ -24,6 +24,8 @@
 #include <Python.h>
 #include <libssh2.h>
 
+#include "session.h"
+
 extern int init_libssh2_Channel(PyObject *);
 
 extern PyTypeObject PYLIBSSH2_Channel_Type;
@@ -32,8 +34,16 @@ extern PyTypeObject PYLIBSSH2_Channel_Type;
 
 typedef struct {
     PyObject_HEAD
-    LIBSSH2_CHANNEL *channel;
-    int             dealloc;
+    LIBSSH2_CHANNEL   *channel;
+    /* parent session, kept alive as long as the channel */
+    PYLIBSSH2_SESSION *session;
+    int               dealloc;
+    /* LIBSSH2_CHANNEL_EXTENDED_DATA_* mode set on the channel */
+    int               extended_data;
+    /* running average of auto-sized reads, on stdout and on stderr */
+    unsigned long     read_hint[2];
 } PYLIBSSH2_CHANNEL;
 
+int channel_socket_fd(PYLIBSSH2_CHANNEL *);
+
 #endif /* _PYLIBSSH2_CHANNEL_H_ */
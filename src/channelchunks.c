@@ -0,0 +1,227 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <Python.h>
+#define PYLIBSSH2_MODULE
+#include "pylibssh2.h"
+
+/* {{{ channelchunks_buffer
+ *
+ * Returns a borrowed pool buffer nobody else references, sized for a read.
+ * A buffer still held by the consumer is left to it and replaced.
+ */
+static PyObject *
+channelchunks_buffer(PYLIBSSH2_CHANNELCHUNKS *self)
+{
+    int i, slot;
+    PyObject *buffer;
+
+    for (i = 0; i < self->pool_size; i++) {
+        slot = (self->next + i) % self->pool_size;
+        buffer = self->pool[slot];
+        /* a memoryview over the buffer holds a reference to it */
+        if (buffer != NULL && Py_REFCNT(buffer) == 1) {
+            self->next = (slot + 1) % self->pool_size;
+            /* regrows in place up to the size the buffer last held */
+            if (PyByteArray_Resize(buffer, self->size) < 0) {
+                return NULL;
+            }
+            return buffer;
+        }
+    }
+
+    slot = self->next;
+    buffer = PyByteArray_FromStringAndSize(NULL, self->size);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    Py_XDECREF(self->pool[slot]);
+    self->pool[slot] = buffer;
+    self->next = (slot + 1) % self->pool_size;
+
+    return buffer;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelChunks_iternext
+ */
+static PyObject *
+PYLIBSSH2_ChannelChunks_iternext(PYLIBSSH2_CHANNELCHUNKS *self)
+{
+    int rc;
+    int sock;
+    PyObject *buffer;
+
+    /* the pool buffer being read into could be resized by another thread */
+    if (self->busy) {
+        PyErr_SetString(PYLIBSSH2_Error,
+                        "Channel chunks are being read by another thread.");
+        return NULL;
+    }
+
+    buffer = channelchunks_buffer(self);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    sock = channel_socket_fd(self->channel);
+
+    self->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->channel->session)
+    while (1) {
+        rc = libssh2_channel_read_ex(self->channel->channel, self->stream_id,
+                                     PyByteArray_AS_STRING(buffer), self->size);
+        if (rc != LIBSSH2_ERROR_EAGAIN || sock < 0 ||
+            (rc = wait_session(self->channel->session->session, sock)) < 0) {
+            break;
+        }
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->channel->session)
+    self->busy = 0;
+
+    if (rc == 0) {
+        return NULL;
+    }
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+    if (rc < 0) {
+        /* CLEAN: PYLIBSSH2_CANT_READ_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read channel (error %d).", rc);
+        return NULL;
+    }
+
+    if (PyByteArray_Resize(buffer, rc) < 0) {
+        return NULL;
+    }
+
+    if (self->as_memoryview) {
+        /* the view references the buffer, which keeps it out of the pool
+           until the view is released */
+        return PyMemoryView_FromObject(buffer);
+    }
+
+    Py_INCREF(buffer);
+
+    return buffer;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelChunks_New
+ */
+PYLIBSSH2_CHANNELCHUNKS *
+PYLIBSSH2_ChannelChunks_New(PYLIBSSH2_CHANNEL *channel, int stream_id,
+                            Py_ssize_t size, int as_memoryview, int pool_size)
+{
+    int i;
+    PYLIBSSH2_CHANNELCHUNKS *self;
+
+    self = PyObject_New(PYLIBSSH2_CHANNELCHUNKS, &PYLIBSSH2_ChannelChunks_Type);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->pool = PyMem_New(PyObject *, pool_size);
+    if (self->pool == NULL) {
+        PyObject_Del(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (i = 0; i < pool_size; i++) {
+        self->pool[i] = NULL;
+    }
+
+    Py_INCREF(channel);
+    self->channel = channel;
+    self->stream_id = stream_id;
+    self->size = size;
+    self->as_memoryview = as_memoryview;
+    self->pool_size = pool_size;
+    self->next = 0;
+    self->busy = 0;
+
+    return self;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelChunks_dealloc
+ */
+static void
+PYLIBSSH2_ChannelChunks_dealloc(PYLIBSSH2_CHANNELCHUNKS *self)
+{
+    int i;
+
+    for (i = 0; i < self->pool_size; i++) {
+        Py_XDECREF(self->pool[i]);
+    }
+    PyMem_Free(self->pool);
+    Py_XDECREF(self->channel);
+
+    PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelChunks_Type
+ *
+ * see /usr/include/python2.5/object.h line 261
+ */
+PyTypeObject PYLIBSSH2_ChannelChunks_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "ChannelChunks",                            /* tp_name */
+    sizeof(PYLIBSSH2_CHANNELCHUNKS),            /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PYLIBSSH2_ChannelChunks_dealloc, /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Channel chunk iterator objects",           /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    PyObject_SelfIter,                          /* tp_iter */
+    (iternextfunc)PYLIBSSH2_ChannelChunks_iternext, /* tp_iternext */
+};
+/* }}} */
+
+/* {{{ init_libssh2_ChannelChunks
+ */
+int
+init_libssh2_ChannelChunks(PyObject *dict)
+{
+    PYLIBSSH2_ChannelChunks_Type.ob_type = &PyType_Type;
+    Py_XINCREF(&PYLIBSSH2_ChannelChunks_Type);
+    PyDict_SetItemString(dict, "ChannelChunksType", (PyObject *)&PYLIBSSH2_ChannelChunks_Type);
+
+    return 1;
+}
+/* }}} */
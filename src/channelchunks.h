@@ -0,0 +1,51 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef _PYLIBSSH2_CHANNELCHUNKS_H_
+#define _PYLIBSSH2_CHANNELCHUNKS_H_
+
+#include <Python.h>
+#include <libssh2.h>
+
+#include "channel.h"
+
+extern int init_libssh2_ChannelChunks(PyObject *);
+
+extern PyTypeObject PYLIBSSH2_ChannelChunks_Type;
+
+#define PYLIBSSH2_ChannelChunks_Check(v) ((v)->ob_type == &PYLIBSSH2_ChannelChunks_Type)
+
+typedef struct {
+    PyObject_HEAD
+    PYLIBSSH2_CHANNEL *channel;
+    int               stream_id;
+    Py_ssize_t        size;
+    /* yield memoryviews instead of bytearrays */
+    int               as_memoryview;
+    /* bytearrays recycled once the consumer has released them */
+    PyObject          **pool;
+    int               pool_size;
+    int               next;
+    /* a read is filling a pool buffer with the GIL released */
+    int               busy;
+} PYLIBSSH2_CHANNELCHUNKS;
+
+PYLIBSSH2_CHANNELCHUNKS * PYLIBSSH2_ChannelChunks_New(PYLIBSSH2_CHANNEL *, int, Py_ssize_t, int, int);
+
+#endif /* _PYLIBSSH2_CHANNELCHUNKS_H_ */
@@ -0,0 +1,481 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <Python.h>
+#include <string.h>
+#define PYLIBSSH2_MODULE
+#include "pylibssh2.h"
+
+/* {{{ find_delim
+ *
+ * Returns the first occurrence of delim in p[0:len] or NULL.
+ */
+static const char *
+find_delim(const char *p, size_t len, const char *delim, size_t delim_len)
+{
+    const char *last = p + len;
+
+    while ((size_t)(last - p) >= delim_len) {
+        p = memchr(p, delim[0], last - p - delim_len + 1);
+        if (p == NULL) {
+            return NULL;
+        }
+        if (memcmp(p, delim, delim_len) == 0) {
+            return p;
+        }
+        p++;
+    }
+
+    return NULL;
+}
+/* }}} */
+
+/* {{{ channelfile_busy
+ *
+ * Raises when another thread is reading, as libssh2 writes into the buffer
+ * with the GIL released and the buffered offsets move under a reader.
+ */
+static int
+channelfile_busy(PYLIBSSH2_CHANNELFILE *self)
+{
+    if (self->busy) {
+        PyErr_SetString(PYLIBSSH2_Error,
+                        "Channel file is being read by another thread.");
+        return 1;
+    }
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ channelfile_take
+ *
+ * Consumes len buffered bytes into a new string.
+ */
+static PyObject *
+channelfile_take(PYLIBSSH2_CHANNELFILE *self, size_t len)
+{
+    PyObject *data;
+
+    data = PyString_FromStringAndSize(self->buffer + self->start, len);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    self->start += len;
+    if (self->start == self->end) {
+        self->start = self->end = 0;
+    }
+
+    return data;
+}
+/* }}} */
+
+/* {{{ channelfile_fill
+ *
+ * Appends channel data to the buffer, moving unread bytes to its head and
+ * growing it when it is full. When wait is set, LIBSSH2_ERROR_EAGAIN is
+ * handled by polling the session socket. Returns the number of bytes read,
+ * 0 on EOF, LIBSSH2_ERROR_EAGAIN or another negative value with a Python
+ * exception set.
+ */
+static int
+channelfile_fill(PYLIBSSH2_CHANNELFILE *self, int wait)
+{
+    int rc;
+    int sock = -1;
+    char *grown;
+
+    if (self->eof) {
+        return 0;
+    }
+
+    if (self->start > 0) {
+        memmove(self->buffer, self->buffer + self->start,
+                self->end - self->start);
+        self->end -= self->start;
+        self->start = 0;
+    }
+
+    if (self->end == self->size) {
+        grown = PyMem_Realloc(self->buffer, self->size * 2);
+        if (grown == NULL) {
+            PyErr_NoMemory();
+            return LIBSSH2_ERROR_ALLOC;
+        }
+        self->buffer = grown;
+        self->size *= 2;
+    }
+
+    if (wait) {
+        sock = channel_socket_fd(self->channel);
+    }
+
+    self->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->channel->session)
+    while (1) {
+        rc = libssh2_channel_read_ex(self->channel->channel, self->stream_id,
+                                     self->buffer + self->end,
+                                     self->size - self->end);
+        if (rc != LIBSSH2_ERROR_EAGAIN || sock < 0 ||
+            (rc = wait_session(self->channel->session->session, sock)) < 0) {
+            break;
+        }
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->channel->session)
+    self->busy = 0;
+
+    if (rc > 0) {
+        self->end += rc;
+    }
+    else if (rc == 0) {
+        self->eof = 1;
+    }
+    else if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        session_timeout_error();
+    }
+    else if (rc != LIBSSH2_ERROR_EAGAIN) {
+        /* CLEAN: PYLIBSSH2_CANT_READ_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read channel (error %d).", rc);
+    }
+
+    return rc;
+}
+/* }}} */
+
+/* {{{ channelfile_readuntil
+ */
+static PyObject *
+channelfile_readuntil(PYLIBSSH2_CHANNELFILE *self, const char *delim,
+                      size_t delim_len, Py_ssize_t limit, int wait)
+{
+    int rc;
+    /* buffered bytes already searched without match */
+    size_t scanned = 0;
+    size_t avail, window;
+    const char *found;
+
+    if (channelfile_busy(self)) {
+        return NULL;
+    }
+
+    while (1) {
+        avail = self->end - self->start;
+        window = avail;
+        if (limit >= 0 && window > (size_t)limit) {
+            window = limit;
+        }
+
+        found = find_delim(self->buffer + self->start + scanned,
+                           window - scanned, delim, delim_len);
+        if (found != NULL) {
+            return channelfile_take(self, found + delim_len -
+                                          (self->buffer + self->start));
+        }
+        if (limit >= 0 && avail >= (size_t)limit) {
+            return channelfile_take(self, limit);
+        }
+
+        /* a delimiter may straddle the current end of the buffer */
+        scanned = window >= delim_len ? window - delim_len + 1 : 0;
+
+        rc = channelfile_fill(self, wait);
+        if (rc == 0) {
+            return channelfile_take(self, self->end - self->start);
+        }
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            return Py_BuildValue("i", rc);
+        }
+        if (rc < 0) {
+            return NULL;
+        }
+    }
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_read
+ */
+static char PYLIBSSH2_ChannelFile_read_doc[] = "\n\
+read([size]) -> str\n\
+\n\
+Reads size bytes from the buffered stream, or up to EOF.\n\
+\n\
+@param  size: number of bytes to read, -1 to read up to EOF\n\
+@type   size: int\n\
+\n\
+@return string containing bytes read, empty at EOF, or\n\
+        LIBSSH2_ERROR_EAGAIN if nothing is buffered and it would block\n\
+@rtype  str or int";
+
+static PyObject *
+PYLIBSSH2_ChannelFile_read(PYLIBSSH2_CHANNELFILE *self, PyObject *args)
+{
+    int rc;
+    Py_ssize_t size = -1;
+    size_t avail;
+
+    if (!PyArg_ParseTuple(args, "|n:read", &size)) {
+        return NULL;
+    }
+
+    if (channelfile_busy(self)) {
+        return NULL;
+    }
+
+    while (size < 0 || self->end - self->start < (size_t)size) {
+        rc = channelfile_fill(self, 0);
+        if (rc == 0) {
+            break;
+        }
+        if (rc == LIBSSH2_ERROR_EAGAIN) {
+            if (self->end == self->start) {
+                return Py_BuildValue("i", rc);
+            }
+            break;
+        }
+        if (rc < 0) {
+            return NULL;
+        }
+    }
+
+    avail = self->end - self->start;
+    if (size >= 0 && avail > (size_t)size) {
+        avail = size;
+    }
+
+    return channelfile_take(self, avail);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_readline
+ */
+static char PYLIBSSH2_ChannelFile_readline_doc[] = "\n\
+readline([limit]) -> str\n\
+\n\
+Reads one line, including its trailing newline.\n\
+\n\
+@param  limit: maximum number of bytes to return, -1 for no limit\n\
+@type   limit: int\n\
+\n\
+@return the line, the remaining bytes at EOF or LIBSSH2_ERROR_EAGAIN if\n\
+        the line is not complete yet (non blocking mode)\n\
+@rtype  str or int";
+
+static PyObject *
+PYLIBSSH2_ChannelFile_readline(PYLIBSSH2_CHANNELFILE *self, PyObject *args)
+{
+    Py_ssize_t limit = -1;
+
+    if (!PyArg_ParseTuple(args, "|n:readline", &limit)) {
+        return NULL;
+    }
+
+    return channelfile_readuntil(self, "\n", 1, limit, 0);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_readuntil
+ */
+static char PYLIBSSH2_ChannelFile_readuntil_doc[] = "\n\
+readuntil(delim, [limit]) -> str\n\
+\n\
+Reads up to and including the next occurrence of delim.\n\
+\n\
+@param  delim: delimiter to look for\n\
+@type   delim: str\n\
+@param  limit: maximum number of bytes to return, -1 for no limit\n\
+@type   limit: int\n\
+\n\
+@return bytes read, the remaining bytes at EOF or LIBSSH2_ERROR_EAGAIN if\n\
+        the delimiter is not found yet (non blocking mode)\n\
+@rtype  str or int";
+
+static PyObject *
+PYLIBSSH2_ChannelFile_readuntil(PYLIBSSH2_CHANNELFILE *self, PyObject *args)
+{
+    char *delim;
+    int delim_len;
+    Py_ssize_t limit = -1;
+
+    if (!PyArg_ParseTuple(args, "s#|n:readuntil", &delim, &delim_len, &limit)) {
+        return NULL;
+    }
+
+    if (delim_len == 0) {
+        PyErr_SetString(PyExc_ValueError, "empty delimiter");
+        return NULL;
+    }
+
+    return channelfile_readuntil(self, delim, delim_len, limit, 0);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_methods[]
+ *
+ * ADD_METHOD(name) expands to a correct PyMethodDef declaration
+ *  { 'name', (PyCFunction)PYLIBSSH2_ChannelFile_name, METHOD_VARARGS }
+ *  for convenience
+ */
+#define ADD_METHOD(name) \
+{ #name, (PyCFunction)PYLIBSSH2_ChannelFile_##name, METH_VARARGS, PYLIBSSH2_ChannelFile_##name##_doc }
+
+static PyMethodDef PYLIBSSH2_ChannelFile_methods[] =
+{
+    ADD_METHOD(read),
+    ADD_METHOD(readline),
+    ADD_METHOD(readuntil),
+    { NULL, NULL }
+};
+#undef ADD_METHOD
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_New
+ */
+PYLIBSSH2_CHANNELFILE *
+PYLIBSSH2_ChannelFile_New(PYLIBSSH2_CHANNEL *channel, int stream_id,
+                          size_t bufsize)
+{
+    PYLIBSSH2_CHANNELFILE *self;
+
+    self = PyObject_New(PYLIBSSH2_CHANNELFILE, &PYLIBSSH2_ChannelFile_Type);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    if (bufsize == 0) {
+        bufsize = 1;
+    }
+    self->buffer = PyMem_Malloc(bufsize);
+    if (self->buffer == NULL) {
+        PyObject_Del(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    Py_INCREF(channel);
+    self->channel = channel;
+    self->stream_id = stream_id;
+    self->size = bufsize;
+    self->start = 0;
+    self->end = 0;
+    self->eof = 0;
+    self->busy = 0;
+
+    return self;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_dealloc
+ */
+static void
+PYLIBSSH2_ChannelFile_dealloc(PYLIBSSH2_CHANNELFILE *self)
+{
+    PyMem_Free(self->buffer);
+    Py_XDECREF(self->channel);
+
+    PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_iternext
+ *
+ * Iterates over lines, waiting on the session socket in non blocking mode.
+ */
+static PyObject *
+PYLIBSSH2_ChannelFile_iternext(PYLIBSSH2_CHANNELFILE *self)
+{
+    PyObject *line;
+
+    line = channelfile_readuntil(self, "\n", 1, -1, 1);
+    if (line == NULL) {
+        return NULL;
+    }
+
+    if (!PyString_Check(line)) {
+        Py_DECREF(line);
+        PyErr_SetString(PYLIBSSH2_Error, "Channel would block.");
+        return NULL;
+    }
+
+    if (PyString_GET_SIZE(line) == 0) {
+        Py_DECREF(line);
+        return NULL;
+    }
+
+    return line;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_getattr
+ */
+static PyObject *
+PYLIBSSH2_ChannelFile_getattr(PYLIBSSH2_CHANNELFILE *self, char *name)
+{
+    return Py_FindMethod(PYLIBSSH2_ChannelFile_methods, (PyObject *)self, name);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelFile_Type
+ *
+ * see /usr/include/python2.5/object.h line 261
+ */
+PyTypeObject PYLIBSSH2_ChannelFile_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "ChannelFile",                              /* tp_name */
+    sizeof(PYLIBSSH2_CHANNELFILE),              /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PYLIBSSH2_ChannelFile_dealloc,  /* tp_dealloc */
+    0,                                          /* tp_print */
+    (getattrfunc)PYLIBSSH2_ChannelFile_getattr, /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Buffered channel reader objects",          /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    PyObject_SelfIter,                          /* tp_iter */
+    (iternextfunc)PYLIBSSH2_ChannelFile_iternext, /* tp_iternext */
+};
+/* }}} */
+
+/* {{{ init_libssh2_ChannelFile
+ */
+int
+init_libssh2_ChannelFile(PyObject *dict)
+{
+    PYLIBSSH2_ChannelFile_Type.ob_type = &PyType_Type;
+    Py_XINCREF(&PYLIBSSH2_ChannelFile_Type);
+    PyDict_SetItemString(dict, "ChannelFileType", (PyObject *)&PYLIBSSH2_ChannelFile_Type);
+
+    return 1;
+}
+/* }}} */
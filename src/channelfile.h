@@ -0,0 +1,50 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef _PYLIBSSH2_CHANNELFILE_H_
+#define _PYLIBSSH2_CHANNELFILE_H_
+
+#include <Python.h>
+#include <libssh2.h>
+
+#include "channel.h"
+
+extern int init_libssh2_ChannelFile(PyObject *);
+
+extern PyTypeObject PYLIBSSH2_ChannelFile_Type;
+
+#define PYLIBSSH2_ChannelFile_Check(v) ((v)->ob_type == &PYLIBSSH2_ChannelFile_Type)
+
+typedef struct {
+    PyObject_HEAD
+    PYLIBSSH2_CHANNEL *channel;
+    int               stream_id;
+    /* buffered bytes are buffer[start:end] */
+    char              *buffer;
+    size_t            size;
+    size_t            start;
+    size_t            end;
+    int               eof;
+    /* a read is filling the buffer with the GIL released */
+    int               busy;
+} PYLIBSSH2_CHANNELFILE;
+
+PYLIBSSH2_CHANNELFILE * PYLIBSSH2_ChannelFile_New(PYLIBSSH2_CHANNEL *, int, size_t);
+
+#endif /* _PYLIBSSH2_CHANNELFILE_H_ */
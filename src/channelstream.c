@@ -0,0 +1,288 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <Python.h>
+#define PYLIBSSH2_MODULE
+#include "pylibssh2.h"
+
+/* {{{ channelstream_wait
+ *
+ * Waits on the session socket after a call returned LIBSSH2_ERROR_EAGAIN.
+ * Returns 0 when the call can be retried, LIBSSH2_ERROR_TIMEOUT or
+ * LIBSSH2_ERROR_SOCKET_RECV.
+ */
+static int
+channelstream_wait(LIBSSH2_SESSION *session, int fd, int timeout)
+{
+    int rc;
+
+    if (fd < 0) {
+        return LIBSSH2_ERROR_SOCKET_RECV;
+    }
+
+    rc = wait_socket(session, fd, timeout);
+    if (rc == 0) {
+        return LIBSSH2_ERROR_TIMEOUT;
+    }
+
+    return rc < 0 ? LIBSSH2_ERROR_SOCKET_RECV : 0;
+}
+/* }}} */
+
+/* {{{ channelstream_read
+ *
+ * Reads the next chunk on stdout or stderr, polling the socket while
+ * neither stream has data. Returns the number of bytes read with
+ * *stream_id set, 0 once the remote side has closed the channel with
+ * *exit_status set, or a negative libssh2 error. Runs without the GIL,
+ * with the session lock held and the session in non blocking mode.
+ */
+static int
+channelstream_read(PYLIBSSH2_CHANNELSTREAM *self, int fd, int *stream_id,
+                   int *exit_status)
+{
+    int i;
+    int rc;
+    LIBSSH2_SESSION *session = self->channel->session->session;
+    LIBSSH2_CHANNEL *channel = self->channel->channel;
+
+    while (1) {
+        for (i = 0; i < 2; i++) {
+            *stream_id = (self->next_stream + i) % 2;
+            rc = libssh2_channel_read_ex(channel, *stream_id, self->buffer,
+                                         self->size);
+            if (rc > 0 || (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN)) {
+                return rc;
+            }
+        }
+
+        if (libssh2_channel_eof(channel)) {
+            break;
+        }
+
+        rc = channelstream_wait(session, fd, self->timeout);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    /* the exit status may follow EOF, it is known once the channel closes */
+    while ((rc = libssh2_channel_wait_closed(channel)) == LIBSSH2_ERROR_EAGAIN) {
+        rc = channelstream_wait(session, fd, self->timeout);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+    if (rc < 0) {
+        return rc;
+    }
+
+    *exit_status = libssh2_channel_get_exit_status(channel);
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelStream_methods[]
+ */
+static PyMethodDef PYLIBSSH2_ChannelStream_methods[] = {
+    { NULL, NULL }
+};
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelStream_New
+ *
+ * Executes command on the channel and returns the iterator over its output.
+ */
+PYLIBSSH2_CHANNELSTREAM *
+PYLIBSSH2_ChannelStream_New(PYLIBSSH2_CHANNEL *channel, char *command,
+                            int size, double timeout)
+{
+    int rc;
+    int fd;
+    int blocking;
+    PYLIBSSH2_CHANNELSTREAM *self;
+    LIBSSH2_SESSION *session = channel->session->session;
+
+    self = PyObject_New(PYLIBSSH2_CHANNELSTREAM, &PYLIBSSH2_ChannelStream_Type);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->buffer = PyMem_Malloc(size);
+    if (self->buffer == NULL) {
+        PyObject_Del(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    Py_INCREF(channel);
+    self->channel = channel;
+    self->size = size;
+    self->timeout = timeout < 0 ? -1 : (int)(timeout * 1000);
+    self->next_stream = 0;
+    self->done = 0;
+
+    fd = channel_socket_fd(channel);
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(channel->session)
+    blocking = libssh2_session_get_blocking(session);
+    libssh2_session_set_blocking(session, 0);
+    while ((rc = libssh2_channel_exec(channel->channel, command)) == LIBSSH2_ERROR_EAGAIN) {
+        rc = channelstream_wait(session, fd, self->timeout);
+        if (rc < 0) {
+            break;
+        }
+    }
+    libssh2_session_set_blocking(session, blocking);
+    PYLIBSSH2_END_ALLOW_THREADS(channel->session)
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        Py_DECREF(self);
+        return (PYLIBSSH2_CHANNELSTREAM *)session_timeout_error();
+    }
+    if (rc < 0) {
+        Py_DECREF(self);
+        /* CLEAN: PYLIBSSH2_CANT_REQUEST_EXEC_COMMAND_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to request exec command (error %d).", rc);
+        return NULL;
+    }
+
+    return self;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelStream_dealloc
+ */
+static void
+PYLIBSSH2_ChannelStream_dealloc(PYLIBSSH2_CHANNELSTREAM *self)
+{
+    PyMem_Free(self->buffer);
+    Py_XDECREF(self->channel);
+
+    PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelStream_iternext
+ *
+ * Returns (stream_id, data) chunks as they arrive, then a single
+ * (CHANNELSTREAM_EXIT_STATUS, exit_status) record.
+ */
+static PyObject *
+PYLIBSSH2_ChannelStream_iternext(PYLIBSSH2_CHANNELSTREAM *self)
+{
+    int rc;
+    int fd;
+    int blocking;
+    int stream_id = 0;
+    int exit_status = -1;
+    PYLIBSSH2_SESSION *session = self->channel->session;
+
+    if (self->done) {
+        return NULL;
+    }
+
+    fd = channel_socket_fd(self->channel);
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(session)
+    blocking = libssh2_session_get_blocking(session->session);
+    libssh2_session_set_blocking(session->session, 0);
+    rc = channelstream_read(self, fd, &stream_id, &exit_status);
+    libssh2_session_set_blocking(session->session, blocking);
+    PYLIBSSH2_END_ALLOW_THREADS(session)
+
+    if (rc > 0) {
+        self->next_stream = !stream_id;
+        return Py_BuildValue("(is#)", stream_id, self->buffer, rc);
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    self->done = 1;
+
+    if (rc < 0) {
+        /* CLEAN: PYLIBSSH2_CANT_READ_CHANNEL_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read channel (error %d).", rc);
+        return NULL;
+    }
+
+    return Py_BuildValue("(ii)", CHANNELSTREAM_EXIT_STATUS, exit_status);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelStream_getattr
+ */
+static PyObject *
+PYLIBSSH2_ChannelStream_getattr(PYLIBSSH2_CHANNELSTREAM *self, char *name)
+{
+    return Py_FindMethod(PYLIBSSH2_ChannelStream_methods, (PyObject *)self, name);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_ChannelStream_Type
+ *
+ * see /usr/include/python2.5/object.h line 261
+ */
+PyTypeObject PYLIBSSH2_ChannelStream_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "ChannelStream",                            /* tp_name */
+    sizeof(PYLIBSSH2_CHANNELSTREAM),            /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PYLIBSSH2_ChannelStream_dealloc, /* tp_dealloc */
+    0,                                          /* tp_print */
+    (getattrfunc)PYLIBSSH2_ChannelStream_getattr, /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Tagged command output iterator objects",   /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    PyObject_SelfIter,                          /* tp_iter */
+    (iternextfunc)PYLIBSSH2_ChannelStream_iternext, /* tp_iternext */
+};
+/* }}} */
+
+/* {{{ init_libssh2_ChannelStream
+ */
+int
+init_libssh2_ChannelStream(PyObject *dict)
+{
+    PYLIBSSH2_ChannelStream_Type.ob_type = &PyType_Type;
+    Py_XINCREF(&PYLIBSSH2_ChannelStream_Type);
+    PyDict_SetItemString(dict, "ChannelStreamType", (PyObject *)&PYLIBSSH2_ChannelStream_Type);
+
+    return 1;
+}
+/* }}} */
@@ -0,0 +1,52 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef _PYLIBSSH2_CHANNELSTREAM_H_
+#define _PYLIBSSH2_CHANNELSTREAM_H_
+
+#include <Python.h>
+#include <libssh2.h>
+
+#include "channel.h"
+
+/* stream id of the exit status record ending an exec_stream() */
+#define CHANNELSTREAM_EXIT_STATUS -1
+
+extern int init_libssh2_ChannelStream(PyObject *);
+
+extern PyTypeObject PYLIBSSH2_ChannelStream_Type;
+
+#define PYLIBSSH2_ChannelStream_Check(v) ((v)->ob_type == &PYLIBSSH2_ChannelStream_Type)
+
+typedef struct {
+    PyObject_HEAD
+    PYLIBSSH2_CHANNEL *channel;
+    char              *buffer;
+    int               size;
+    /* milliseconds to wait for output, -1 to wait forever */
+    int               timeout;
+    /* stream read first on the next pass, alternated for fairness */
+    int               next_stream;
+    /* set once the exit status record has been returned */
+    int               done;
+} PYLIBSSH2_CHANNELSTREAM;
+
+PYLIBSSH2_CHANNELSTREAM * PYLIBSSH2_ChannelStream_New(PYLIBSSH2_CHANNEL *, char *, int, double);
+
+#endif /* _PYLIBSSH2_CHANNELSTREAM_H_ */
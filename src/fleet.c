@@ -0,0 +1,701 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <Python.h>
+#define PYLIBSSH2_MODULE
+#include "pylibssh2.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* {{{ PYLIBSSH2_FleetResult_Type
+ */
+static PyStructSequence_Field fleet_result_fields[] = {
+    { "host", "remote host name" },
+    { "port", "remote port" },
+    { "exit_status", "exit code of the command, -1 on failure" },
+    { "stdout", "data read on the channel" },
+    { "stderr", "data read on the channel stderr" },
+    { "error", "description of the failure or None" },
+    { "connect_time", "seconds spent connecting the socket" },
+    { "auth_time", "seconds spent in handshake and authentication" },
+    { "exec_time", "seconds spent running the command" },
+    { "total_time", "seconds spent on the host" },
+    { NULL }
+};
+
+static PyStructSequence_Desc fleet_result_desc = {
+    "FleetResult",
+    "Result of a command run on one host by run_many()",
+    fleet_result_fields,
+    10
+};
+
+PyTypeObject PYLIBSSH2_FleetResult_Type;
+/* }}} */
+
+/* {{{ fleet_now
+ */
+static double
+fleet_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+/* }}} */
+
+/* {{{ fleet_reserve
+ *
+ * Makes room for at least min bytes after the buffered data.
+ */
+static int
+fleet_reserve(PYLIBSSH2_FLEET_BUFFER *buffer, size_t min)
+{
+    size_t size;
+    char *data;
+
+    if (buffer->size - buffer->len >= min) {
+        return 0;
+    }
+
+    size = buffer->size ? buffer->size : min;
+    while (size - buffer->len < min) {
+        size *= 2;
+    }
+    data = realloc(buffer->data, size);
+    if (data == NULL) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->size = size;
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ fleet_connect
+ *
+ * Connects a TCP socket to host:port within timeout milliseconds (0 for
+ * none). Returns the descriptor or -1 with job->error filled.
+ */
+static int
+fleet_connect(PYLIBSSH2_FLEET_JOB *job, long timeout)
+{
+    int fd = -1;
+    int rc;
+    int flags;
+    int so_error;
+    socklen_t so_len;
+    char port[16];
+    struct addrinfo hints, *res, *ai;
+    struct pollfd pfd;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", job->port);
+
+    rc = getaddrinfo(job->host, port, &hints, &res);
+    if (rc != 0) {
+        snprintf(job->error, sizeof(job->error),
+                 "Unable to resolve host (%s).", gai_strerror(rc));
+        return -1;
+    }
+
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+        rc = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc < 0 && errno == EINPROGRESS) {
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            do {
+                rc = poll(&pfd, 1, timeout > 0 ? (int)timeout : -1);
+            } while (rc < 0 && errno == EINTR);
+
+            if (rc == 0) {
+                errno = ETIMEDOUT;
+                rc = -1;
+            } else if (rc > 0) {
+                so_len = sizeof(so_error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &so_len);
+                errno = so_error;
+                rc = so_error ? -1 : 0;
+            }
+        }
+
+        if (rc == 0) {
+            fcntl(fd, F_SETFL, flags);
+            break;
+        }
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        snprintf(job->error, sizeof(job->error),
+                 "Unable to connect (%s).", strerror(errno));
+    }
+
+    return fd;
+}
+/* }}} */
+
+/* {{{ fleet_fail
+ *
+ * Describes the last libssh2 error of the session in job->error.
+ */
+static void
+fleet_fail(PYLIBSSH2_FLEET_JOB *job, LIBSSH2_SESSION *session,
+           const char *what, int rc)
+{
+    char *message = NULL;
+
+    libssh2_session_last_error(session, &message, NULL, 0);
+    snprintf(job->error, sizeof(job->error), "Unable to %s (error %d): %s",
+             what, rc, message != NULL ? message : "");
+}
+/* }}} */
+
+/* {{{ fleet_drain
+ *
+ * Reads stdout and stderr until EOF without blocking on either stream.
+ */
+static int
+fleet_drain(PYLIBSSH2_FLEET_JOB *job, LIBSSH2_SESSION *session,
+            LIBSSH2_CHANNEL *channel, int fd, long timeout)
+{
+    int i;
+    int rc;
+    int progress;
+    PYLIBSSH2_FLEET_BUFFER *buffer;
+
+    libssh2_session_set_blocking(session, 0);
+
+    while (!libssh2_channel_eof(channel)) {
+        progress = 0;
+        for (i = 0; i < 2; i++) {
+            buffer = i ? &job->err : &job->out;
+            if (fleet_reserve(buffer, 32768) < 0) {
+                snprintf(job->error, sizeof(job->error), "Out of memory.");
+                return -1;
+            }
+            rc = libssh2_channel_read_ex(channel, i, buffer->data + buffer->len,
+                                         buffer->size - buffer->len);
+            if (rc > 0) {
+                buffer->len += rc;
+                progress = 1;
+            } else if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+                fleet_fail(job, session, "read channel", rc);
+                return -1;
+            }
+        }
+
+        if (!progress && !libssh2_channel_eof(channel)) {
+            rc = wait_socket(session, fd, timeout > 0 ? (int)timeout : -1);
+            if (rc == 0) {
+                snprintf(job->error, sizeof(job->error), "Operation timed out.");
+                return -1;
+            }
+            if (rc < 0) {
+                snprintf(job->error, sizeof(job->error),
+                         "Unable to wait on the socket (%s).", strerror(errno));
+                return -1;
+            }
+        }
+    }
+
+    libssh2_session_set_blocking(session, 1);
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ fleet_run_job
+ *
+ * Runs the whole connect, authenticate, execute and collect pipeline of a
+ * host. Called by the worker threads, never touches Python objects.
+ */
+static void
+fleet_run_job(PYLIBSSH2_FLEET *self, PYLIBSSH2_FLEET_JOB *job)
+{
+    int fd;
+    int rc;
+    double start, mark;
+    LIBSSH2_SESSION *session = NULL;
+    LIBSSH2_CHANNEL *channel = NULL;
+
+    start = mark = fleet_now();
+
+    fd = fleet_connect(job, self->timeout);
+    job->connect_time = fleet_now() - mark;
+    if (fd < 0) {
+        goto done;
+    }
+
+    mark = fleet_now();
+    session = libssh2_session_init();
+    if (session == NULL) {
+        snprintf(job->error, sizeof(job->error), "Unable to create session.");
+        goto done;
+    }
+    libssh2_session_set_timeout(session, self->timeout);
+
+    rc = libssh2_session_handshake(session, fd);
+    if (rc) {
+        fleet_fail(job, session, "startup session", rc);
+        goto done;
+    }
+
+    if (job->privatekey != NULL) {
+        rc = libssh2_userauth_publickey_fromfile(session, job->username, NULL,
+                                                 job->privatekey, job->password);
+    } else {
+        rc = libssh2_userauth_password(session, job->username,
+                                       job->password ? job->password : "");
+    }
+    job->auth_time = fleet_now() - mark;
+    if (rc) {
+        fleet_fail(job, session, "authenticate", rc);
+        goto done;
+    }
+
+    mark = fleet_now();
+    channel = libssh2_channel_open_session(session);
+    if (channel == NULL) {
+        fleet_fail(job, session, "open a session",
+                   libssh2_session_last_errno(session));
+        goto exec_done;
+    }
+
+    rc = libssh2_channel_exec(channel, self->command);
+    if (rc) {
+        fleet_fail(job, session, "request exec command", rc);
+        goto exec_done;
+    }
+
+    if (fleet_drain(job, session, channel, fd, self->timeout) < 0) {
+        goto exec_done;
+    }
+
+    rc = libssh2_channel_close(channel);
+    if (rc == 0) {
+        rc = libssh2_channel_wait_closed(channel);
+    }
+    if (rc) {
+        fleet_fail(job, session, "close the channel", rc);
+        goto exec_done;
+    }
+    job->exit_status = libssh2_channel_get_exit_status(channel);
+
+    exec_done:
+    job->exec_time = fleet_now() - mark;
+
+    done:
+    if (channel != NULL) {
+        libssh2_channel_free(channel);
+    }
+    if (session != NULL) {
+        libssh2_session_set_blocking(session, 1);
+        if (job->error[0] == '\0') {
+            libssh2_session_disconnect(session, "Disconnect");
+        }
+        libssh2_session_free(session);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    job->total_time = fleet_now() - start;
+}
+/* }}} */
+
+/* {{{ fleet_worker
+ *
+ * Takes jobs until none are left or the fleet is dropped.
+ */
+static void *
+fleet_worker(void *arg)
+{
+    int i;
+    PYLIBSSH2_FLEET *self = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&self->lock);
+        if (self->cancelled || self->next >= self->njobs) {
+            pthread_mutex_unlock(&self->lock);
+            break;
+        }
+        i = self->next++;
+        pthread_mutex_unlock(&self->lock);
+
+        fleet_run_job(self, &self->jobs[i]);
+
+        pthread_mutex_lock(&self->lock);
+        self->done[self->ndone++] = i;
+        pthread_cond_signal(&self->cond);
+        pthread_mutex_unlock(&self->lock);
+    }
+
+    return NULL;
+}
+/* }}} */
+
+/* {{{ fleet_result
+ *
+ * Converts a finished job into a FleetResult, releasing its buffers.
+ */
+static PyObject *
+fleet_result(PYLIBSSH2_FLEET_JOB *job)
+{
+    PyObject *result;
+    PyObject *error;
+
+    result = PyStructSequence_New(&PYLIBSSH2_FleetResult_Type);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    if (job->error[0] != '\0') {
+        error = PyString_FromString(job->error);
+    } else {
+        Py_INCREF(Py_None);
+        error = Py_None;
+    }
+
+    PyStructSequence_SET_ITEM(result, 0, PyString_FromString(job->host));
+    PyStructSequence_SET_ITEM(result, 1, PyInt_FromLong(job->port));
+    PyStructSequence_SET_ITEM(result, 2, PyInt_FromLong(job->exit_status));
+    PyStructSequence_SET_ITEM(result, 3,
+        PyString_FromStringAndSize(job->out.data, job->out.len));
+    PyStructSequence_SET_ITEM(result, 4,
+        PyString_FromStringAndSize(job->err.data, job->err.len));
+    PyStructSequence_SET_ITEM(result, 5, error);
+    PyStructSequence_SET_ITEM(result, 6, PyFloat_FromDouble(job->connect_time));
+    PyStructSequence_SET_ITEM(result, 7, PyFloat_FromDouble(job->auth_time));
+    PyStructSequence_SET_ITEM(result, 8, PyFloat_FromDouble(job->exec_time));
+    PyStructSequence_SET_ITEM(result, 9, PyFloat_FromDouble(job->total_time));
+
+    free(job->out.data);
+    free(job->err.data);
+    memset(&job->out, 0, sizeof(job->out));
+    memset(&job->err, 0, sizeof(job->err));
+
+    if (PyErr_Occurred()) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Fleet_methods[]
+ */
+static PyMethodDef PYLIBSSH2_Fleet_methods[] = {
+    { NULL, NULL }
+};
+/* }}} */
+
+/* {{{ PYLIBSSH2_Fleet_dealloc
+ */
+static void
+PYLIBSSH2_Fleet_dealloc(PYLIBSSH2_FLEET *self)
+{
+    int i;
+
+    if (self->threads != NULL) {
+        pthread_mutex_lock(&self->lock);
+        self->cancelled = 1;
+        pthread_mutex_unlock(&self->lock);
+
+        /* running jobs finish, bounded by the timeout */
+        Py_BEGIN_ALLOW_THREADS
+        for (i = 0; i < self->nthreads; i++) {
+            pthread_join(self->threads[i], NULL);
+        }
+        Py_END_ALLOW_THREADS
+
+        free(self->threads);
+        pthread_cond_destroy(&self->cond);
+        pthread_mutex_destroy(&self->lock);
+        libssh2_exit();
+    }
+
+    for (i = 0; i < self->njobs; i++) {
+        free(self->jobs[i].host);
+        free(self->jobs[i].username);
+        free(self->jobs[i].password);
+        free(self->jobs[i].privatekey);
+        free(self->jobs[i].out.data);
+        free(self->jobs[i].err.data);
+    }
+    free(self->jobs);
+    free(self->done);
+    free(self->command);
+
+    PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Fleet_New
+ *
+ * Copies the host list and starts the worker threads. Each item of hosts
+ * is a (host, port, username, password[, privatekey]) tuple; with a
+ * private key file, password is its passphrase.
+ */
+PYLIBSSH2_FLEET *
+PYLIBSSH2_Fleet_New(PyObject *hosts, char *command, int concurrency,
+                    double timeout)
+{
+    int i;
+    int rc;
+    char *host, *username, *password, *privatekey;
+    PyObject *items, *item;
+    PYLIBSSH2_FLEET *self;
+    PYLIBSSH2_FLEET_JOB *job;
+
+    if (concurrency < 1) {
+        PyErr_SetString(PyExc_ValueError, "concurrency must be positive");
+        return NULL;
+    }
+
+    items = PySequence_Fast(hosts, "hosts must be a sequence");
+    if (items == NULL) {
+        return NULL;
+    }
+
+    self = PyObject_New(PYLIBSSH2_FLEET, &PYLIBSSH2_Fleet_Type);
+    if (self == NULL) {
+        Py_DECREF(items);
+        return NULL;
+    }
+
+    self->njobs = PySequence_Fast_GET_SIZE(items);
+    self->jobs = calloc(self->njobs ? self->njobs : 1, sizeof(PYLIBSSH2_FLEET_JOB));
+    self->done = calloc(self->njobs ? self->njobs : 1, sizeof(int));
+    self->command = strdup(command);
+    self->timeout = timeout > 0 ? (long)(timeout * 1000) : 0;
+    if (timeout > 0 && self->timeout < 1) {
+        self->timeout = 1;
+    }
+    self->next = 0;
+    self->ndone = 0;
+    self->cancelled = 0;
+    self->nreturned = 0;
+    self->threads = NULL;
+    self->nthreads = 0;
+
+    if (self->jobs == NULL || self->done == NULL || self->command == NULL) {
+        self->njobs = 0;
+        Py_DECREF(items);
+        Py_DECREF(self);
+        return (PYLIBSSH2_FLEET *)PyErr_NoMemory();
+    }
+
+    for (i = 0; i < self->njobs; i++) {
+        item = PySequence_Fast_GET_ITEM(items, i);
+        job = &self->jobs[i];
+        privatekey = NULL;
+
+        if (!PyTuple_Check(item) ||
+            !PyArg_ParseTuple(item, "sisz|z:run_many", &host, &job->port,
+                              &username, &password, &privatekey)) {
+            if (!PyErr_Occurred()) {
+                PyErr_SetString(PyExc_TypeError,
+                    "hosts items must be (host, port, username, password) tuples");
+            }
+            Py_DECREF(items);
+            Py_DECREF(self);
+            return NULL;
+        }
+
+        job->host = strdup(host);
+        job->username = strdup(username);
+        job->password = password ? strdup(password) : NULL;
+        job->privatekey = privatekey ? strdup(privatekey) : NULL;
+        job->exit_status = -1;
+        if (job->host == NULL || job->username == NULL ||
+            (password && job->password == NULL) ||
+            (privatekey && job->privatekey == NULL)) {
+            Py_DECREF(items);
+            Py_DECREF(self);
+            return (PYLIBSSH2_FLEET *)PyErr_NoMemory();
+        }
+    }
+    Py_DECREF(items);
+
+    if (self->njobs == 0) {
+        return self;
+    }
+
+    self->nthreads = concurrency < self->njobs ? concurrency : self->njobs;
+    self->threads = calloc(self->nthreads, sizeof(pthread_t));
+    if (self->threads == NULL) {
+        Py_DECREF(self);
+        return (PYLIBSSH2_FLEET *)PyErr_NoMemory();
+    }
+
+    /* libssh2 must be initialized before sessions are created concurrently */
+    libssh2_init(0);
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->cond, NULL);
+
+    for (i = 0; i < self->nthreads; i++) {
+        rc = pthread_create(&self->threads[i], NULL, fleet_worker, self);
+        if (rc != 0) {
+            break;
+        }
+    }
+    if (i == 0) {
+        self->nthreads = 0;
+        Py_DECREF(self);
+        /* CLEAN: PYLIBSSH2_CANT_START_THREADS_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to start worker threads (error %d).", rc);
+        return NULL;
+    }
+    self->nthreads = i;
+
+    return self;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Fleet_iternext
+ *
+ * Returns results in completion order, waiting for the workers without
+ * the GIL.
+ */
+static PyObject *
+PYLIBSSH2_Fleet_iternext(PYLIBSSH2_FLEET *self)
+{
+    int i = -1;
+    struct timeval now;
+    struct timespec deadline;
+
+    while (i < 0) {
+        if (self->nreturned >= self->njobs) {
+            return NULL;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock(&self->lock);
+        if (self->ndone == self->nreturned) {
+            /* wake up regularly to let Python handle signals */
+            gettimeofday(&now, NULL);
+            deadline.tv_sec = now.tv_sec;
+            deadline.tv_nsec = (now.tv_usec + 100000) * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&self->cond, &self->lock, &deadline);
+        }
+        if (self->ndone > self->nreturned) {
+            i = self->done[self->nreturned++];
+        }
+        pthread_mutex_unlock(&self->lock);
+        Py_END_ALLOW_THREADS
+
+        if (i < 0 && PyErr_CheckSignals()) {
+            return NULL;
+        }
+    }
+
+    return fleet_result(&self->jobs[i]);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Fleet_getattr
+ */
+static PyObject *
+PYLIBSSH2_Fleet_getattr(PYLIBSSH2_FLEET *self, char *name)
+{
+    return Py_FindMethod(PYLIBSSH2_Fleet_methods, (PyObject *)self, name);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Fleet_Type
+ *
+ * see /usr/include/python2.5/object.h line 261
+ */
+PyTypeObject PYLIBSSH2_Fleet_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "Fleet",                                    /* tp_name */
+    sizeof(PYLIBSSH2_FLEET),                    /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PYLIBSSH2_Fleet_dealloc,        /* tp_dealloc */
+    0,                                          /* tp_print */
+    (getattrfunc)PYLIBSSH2_Fleet_getattr,       /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Concurrent command runs over many hosts",  /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    PyObject_SelfIter,                          /* tp_iter */
+    (iternextfunc)PYLIBSSH2_Fleet_iternext,     /* tp_iternext */
+};
+/* }}} */
+
+/* {{{ init_libssh2_Fleet
+ */
+int
+init_libssh2_Fleet(PyObject *dict)
+{
+    PYLIBSSH2_Fleet_Type.ob_type = &PyType_Type;
+    Py_XINCREF(&PYLIBSSH2_Fleet_Type);
+    PyDict_SetItemString(dict, "FleetType", (PyObject *)&PYLIBSSH2_Fleet_Type);
+
+    PyStructSequence_InitType(&PYLIBSSH2_FleetResult_Type, &fleet_result_desc);
+    Py_INCREF(&PYLIBSSH2_FleetResult_Type);
+    PyDict_SetItemString(dict, "FleetResult", (PyObject *)&PYLIBSSH2_FleetResult_Type);
+
+    return 1;
+}
+/* }}} */
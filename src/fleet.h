@@ -0,0 +1,83 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef _PYLIBSSH2_FLEET_H_
+#define _PYLIBSSH2_FLEET_H_
+
+#include <Python.h>
+#include <structseq.h>
+#include <pthread.h>
+#include <libssh2.h>
+
+extern int init_libssh2_Fleet(PyObject *);
+
+extern PyTypeObject PYLIBSSH2_Fleet_Type;
+extern PyTypeObject PYLIBSSH2_FleetResult_Type;
+
+#define PYLIBSSH2_Fleet_Check(v) ((v)->ob_type == &PYLIBSSH2_Fleet_Type)
+
+typedef struct {
+    char   *data;
+    size_t len;
+    size_t size;
+} PYLIBSSH2_FLEET_BUFFER;
+
+typedef struct {
+    /* copied from the hosts sequence */
+    char                  *host;
+    int                   port;
+    char                  *username;
+    char                  *password;
+    /* NULL for password authentication */
+    char                  *privatekey;
+    /* filled by the worker thread */
+    PYLIBSSH2_FLEET_BUFFER out;
+    PYLIBSSH2_FLEET_BUFFER err;
+    int                   exit_status;
+    /* empty on success */
+    char                  error[256];
+    double                connect_time;
+    double                auth_time;
+    double                exec_time;
+    double                total_time;
+} PYLIBSSH2_FLEET_JOB;
+
+typedef struct {
+    PyObject_HEAD
+    char                *command;
+    /* per call timeout in milliseconds, 0 for none */
+    long                timeout;
+    PYLIBSSH2_FLEET_JOB *jobs;
+    int                 njobs;
+    /* shared with the workers, guarded by lock */
+    int                 next;
+    int                 *done;
+    int                 ndone;
+    int                 cancelled;
+    /* finished jobs already returned to Python */
+    int                 nreturned;
+    pthread_t           *threads;
+    int                 nthreads;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+} PYLIBSSH2_FLEET;
+
+PYLIBSSH2_FLEET * PYLIBSSH2_Fleet_New(PyObject *, char *, int, double);
+
+#endif /* _PYLIBSSH2_FLEET_H_ */
@@ -0,0 +1,379 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <Python.h>
+#define PYLIBSSH2_MODULE
+#include "pylibssh2.h"
+
+#include <sys/time.h>
+
+/* {{{ keepalive_service
+ *
+ * Sends the keepalive messages which are due and returns the number of
+ * seconds until the next one. A session busy in another thread is active
+ * anyway and is only looked at again a second later.
+ */
+static int
+keepalive_service(PYLIBSSH2_SESSION *session)
+{
+    int rc;
+    int seconds_to_next = 0;
+
+    if (session->fd < 0) {
+        return KEEPALIVE_IDLE_WAIT;
+    }
+
+    if (session->lock != NULL &&
+        !PyThread_acquire_lock(session->lock, NOWAIT_LOCK)) {
+        return 1;
+    }
+    rc = libssh2_keepalive_send(session->session, &seconds_to_next);
+    if (session->lock != NULL) {
+        PyThread_release_lock(session->lock);
+    }
+
+    if (rc == LIBSSH2_ERROR_EAGAIN) {
+        return 1;
+    }
+    if (rc < 0 || seconds_to_next <= 0) {
+        return KEEPALIVE_IDLE_WAIT;
+    }
+
+    return seconds_to_next;
+}
+/* }}} */
+
+/* {{{ keepalive_driver
+ *
+ * Services every registered session at the interval libssh2 returns,
+ * until the driver is stopped. Never touches Python objects.
+ */
+static void *
+keepalive_driver(void *arg)
+{
+    int i;
+    int next;
+    int wait;
+    struct timeval now;
+    struct timespec deadline;
+    PYLIBSSH2_KEEPALIVE *self = arg;
+
+    pthread_mutex_lock(&self->lock);
+    while (!self->stopped) {
+        wait = KEEPALIVE_IDLE_WAIT;
+        for (i = 0; i < self->nsessions; i++) {
+            next = keepalive_service(self->sessions[i]);
+            if (next < wait) {
+                wait = next;
+            }
+        }
+
+        gettimeofday(&now, NULL);
+        deadline.tv_sec = now.tv_sec + wait;
+        deadline.tv_nsec = now.tv_usec * 1000;
+        pthread_cond_timedwait(&self->cond, &self->lock, &deadline);
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    return NULL;
+}
+/* }}} */
+
+/* {{{ keepalive_find
+ */
+static int
+keepalive_find(PYLIBSSH2_KEEPALIVE *self, PYLIBSSH2_SESSION *session)
+{
+    int i;
+
+    for (i = 0; i < self->nsessions; i++) {
+        if (self->sessions[i] == session) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+/* }}} */
+
+/* {{{ keepalive_acquire
+ *
+ * Takes the driver lock without holding the GIL.
+ */
+static void
+keepalive_acquire(PYLIBSSH2_KEEPALIVE *self)
+{
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->lock);
+    Py_END_ALLOW_THREADS
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_register
+ */
+static char PYLIBSSH2_Keepalive_register_doc[] = "\n\
+register(session) -> None\n\
+\n\
+Services the keepalive messages of a session from the driver thread.\n\
+Keepalives must be configured on the session with keepalive_config().\n\
+\n\
+@param  session: started session\n\
+@type   session: libssh2.Session\n\
+\n\
+@return None";
+
+static PyObject *
+PYLIBSSH2_Keepalive_register(PYLIBSSH2_KEEPALIVE *self, PyObject *args)
+{
+    int allocated;
+    PYLIBSSH2_SESSION *session;
+    PYLIBSSH2_SESSION **sessions;
+
+    if (!PyArg_ParseTuple(args, "O!:register", &PYLIBSSH2_Session_Type, &session)) {
+        return NULL;
+    }
+
+    keepalive_acquire(self);
+
+    if (keepalive_find(self, session) >= 0) {
+        pthread_mutex_unlock(&self->lock);
+        Py_RETURN_NONE;
+    }
+
+    if (self->nsessions == self->allocated) {
+        allocated = self->allocated ? self->allocated * 2 : 8;
+        sessions = PyMem_Realloc(self->sessions,
+                                 allocated * sizeof(PYLIBSSH2_SESSION *));
+        if (sessions == NULL) {
+            pthread_mutex_unlock(&self->lock);
+            return PyErr_NoMemory();
+        }
+        self->sessions = sessions;
+        self->allocated = allocated;
+    }
+
+    Py_INCREF(session);
+    self->sessions[self->nsessions++] = session;
+
+    /* service the new session right away */
+    pthread_cond_signal(&self->cond);
+    pthread_mutex_unlock(&self->lock);
+
+    Py_RETURN_NONE;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_unregister
+ */
+static char PYLIBSSH2_Keepalive_unregister_doc[] = "\n\
+unregister(session) -> None\n\
+\n\
+Stops servicing the keepalive messages of a session.\n\
+\n\
+@param  session: registered session\n\
+@type   session: libssh2.Session\n\
+\n\
+@return None";
+
+static PyObject *
+PYLIBSSH2_Keepalive_unregister(PYLIBSSH2_KEEPALIVE *self, PyObject *args)
+{
+    int i;
+    PYLIBSSH2_SESSION *session;
+
+    if (!PyArg_ParseTuple(args, "O!:unregister", &PYLIBSSH2_Session_Type, &session)) {
+        return NULL;
+    }
+
+    keepalive_acquire(self);
+
+    i = keepalive_find(self, session);
+    if (i < 0) {
+        pthread_mutex_unlock(&self->lock);
+        PyErr_SetString(PyExc_KeyError, "session is not registered");
+        return NULL;
+    }
+    self->sessions[i] = self->sessions[--self->nsessions];
+
+    pthread_mutex_unlock(&self->lock);
+
+    Py_DECREF(session);
+
+    Py_RETURN_NONE;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_stop
+ */
+static char PYLIBSSH2_Keepalive_stop_doc[] = "\n\
+stop() -> None\n\
+\n\
+Stops the driver thread and releases the registered sessions.\n\
+\n\
+@return None";
+
+static PyObject *
+PYLIBSSH2_Keepalive_stop(PYLIBSSH2_KEEPALIVE *self, PyObject *args)
+{
+    int i;
+
+    if (self->running) {
+        keepalive_acquire(self);
+        self->stopped = 1;
+        pthread_cond_signal(&self->cond);
+        pthread_mutex_unlock(&self->lock);
+
+        Py_BEGIN_ALLOW_THREADS
+        pthread_join(self->thread, NULL);
+        Py_END_ALLOW_THREADS
+
+        self->running = 0;
+    }
+
+    for (i = 0; i < self->nsessions; i++) {
+        Py_DECREF(self->sessions[i]);
+    }
+    self->nsessions = 0;
+
+    Py_RETURN_NONE;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_methods[]
+ *
+ * ADD_METHOD(name) expands to a correct PyMethodDef declaration
+ *  { 'name', (PyCFunction)PYLIBSSH2_Keepalive_name, METHOD_VARARGS }
+ *  for convenience
+ */
+#define ADD_METHOD(name) \
+{ #name, (PyCFunction)PYLIBSSH2_Keepalive_##name, METH_VARARGS, PYLIBSSH2_Keepalive_##name##_doc }
+
+static PyMethodDef PYLIBSSH2_Keepalive_methods[] =
+{
+    ADD_METHOD(register),
+    ADD_METHOD(unregister),
+    ADD_METHOD(stop),
+    { NULL, NULL }
+};
+#undef ADD_METHOD
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_New
+ */
+PYLIBSSH2_KEEPALIVE *
+PYLIBSSH2_Keepalive_New(void)
+{
+    int rc;
+    PYLIBSSH2_KEEPALIVE *self;
+
+    self = PyObject_New(PYLIBSSH2_KEEPALIVE, &PYLIBSSH2_Keepalive_Type);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->sessions = NULL;
+    self->nsessions = 0;
+    self->allocated = 0;
+    self->stopped = 0;
+    self->running = 0;
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->cond, NULL);
+
+    rc = pthread_create(&self->thread, NULL, keepalive_driver, self);
+    if (rc != 0) {
+        Py_DECREF(self);
+        /* CLEAN: PYLIBSSH2_CANT_START_THREADS_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to start worker threads (error %d).", rc);
+        return NULL;
+    }
+    self->running = 1;
+
+    return self;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_dealloc
+ */
+static void
+PYLIBSSH2_Keepalive_dealloc(PYLIBSSH2_KEEPALIVE *self)
+{
+    PyObject *rc;
+
+    rc = PYLIBSSH2_Keepalive_stop(self, NULL);
+    Py_XDECREF(rc);
+
+    PyMem_Free(self->sessions);
+    pthread_cond_destroy(&self->cond);
+    pthread_mutex_destroy(&self->lock);
+
+    PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_getattr
+ */
+static PyObject *
+PYLIBSSH2_Keepalive_getattr(PYLIBSSH2_KEEPALIVE *self, char *name)
+{
+    return Py_FindMethod(PYLIBSSH2_Keepalive_methods, (PyObject *)self, name);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Keepalive_Type
+ *
+ * see /usr/include/python2.5/object.h line 261
+ */
+PyTypeObject PYLIBSSH2_Keepalive_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "Keepalive",                                /* tp_name */
+    sizeof(PYLIBSSH2_KEEPALIVE),                /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PYLIBSSH2_Keepalive_dealloc,    /* tp_dealloc */
+    0,                                          /* tp_print */
+    (getattrfunc)PYLIBSSH2_Keepalive_getattr,   /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Background keepalive driver objects",      /* tp_doc */
+};
+/* }}} */
+
+/* {{{ init_libssh2_Keepalive
+ */
+int
+init_libssh2_Keepalive(PyObject *dict)
+{
+    PYLIBSSH2_Keepalive_Type.ob_type = &PyType_Type;
+    Py_XINCREF(&PYLIBSSH2_Keepalive_Type);
+    PyDict_SetItemString(dict, "KeepaliveType", (PyObject *)&PYLIBSSH2_Keepalive_Type);
+
+    return 1;
+}
+/* }}} */
@@ -0,0 +1,53 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef _PYLIBSSH2_KEEPALIVE_H_
+#define _PYLIBSSH2_KEEPALIVE_H_
+
+#include <Python.h>
+#include <pthread.h>
+#include <libssh2.h>
+
+#include "session.h"
+
+/* seconds between passes when no session has keepalives enabled */
+#define KEEPALIVE_IDLE_WAIT 60
+
+extern int init_libssh2_Keepalive(PyObject *);
+
+extern PyTypeObject PYLIBSSH2_Keepalive_Type;
+
+#define PYLIBSSH2_Keepalive_Check(v) ((v)->ob_type == &PYLIBSSH2_Keepalive_Type)
+
+typedef struct {
+    PyObject_HEAD
+    /* registered sessions, shared with the driver thread under lock */
+    PYLIBSSH2_SESSION **sessions;
+    int               nsessions;
+    int               allocated;
+    int               stopped;
+    int               running;
+    pthread_t         thread;
+    pthread_mutex_t   lock;
+    pthread_cond_t    cond;
+} PYLIBSSH2_KEEPALIVE;
+
+PYLIBSSH2_KEEPALIVE * PYLIBSSH2_Keepalive_New(void);
+
+#endif /* _PYLIBSSH2_KEEPALIVE_H_ */
@@ -35,18 +35,24 @@ static PyObject *
 PYLIBSSH2_Listener_accept(PYLIBSSH2_LISTENER *self, PyObject *args)
 {
     LIBSSH2_CHANNEL *channel;
+    int would_block;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     channel = libssh2_channel_forward_accept(self->listener);
-    Py_END_ALLOW_THREADS
+    /* read the error before another thread can take the lock */
+    would_block = channel == NULL && self->session != NULL &&
+        libssh2_session_last_errno(self->session->session) == LIBSSH2_ERROR_EAGAIN;
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (channel == NULL) {
+        if (would_block) {
+            Py_RETURN_NONE;
+        }
         PyErr_SetString(PYLIBSSH2_Error, "Unable to accept listener on channel.");
-        Py_INCREF(Py_None);
-        return Py_None;
+        return NULL;
     }
 
-    return (PyObject *)PYLIBSSH2_Channel_New(channel, 1);
+    return (PyObject *)PYLIBSSH2_Channel_New(channel, self->session, 1);
 }
 /* }}} */
 
@@ -64,9 +70,9 @@ PYLIBSSH2_Listener_cancel(PYLIBSSH2_LISTENER *self, PyObject *args)
 {
     int rc;
     
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc = libssh2_channel_forward_cancel(self->listener);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     return Py_BuildValue("i", rc);
 }
@@ -92,7 +98,8 @@ struct PyMethodDef PYLIBSSH2_Listener_methods[] = {
 /* {{{ PYLIBSSH2_Listener_New
  */
 PYLIBSSH2_LISTENER *
-PYLIBSSH2_Listener_New(LIBSSH2_LISTENER *listener, int dealloc)
+PYLIBSSH2_Listener_New(LIBSSH2_LISTENER *listener, PYLIBSSH2_SESSION *session,
+                       int dealloc)
 {
     PYLIBSSH2_LISTENER *self;
 
@@ -104,6 +111,9 @@ PYLIBSSH2_Listener_New(LIBSSH2_LISTENER *listener, int dealloc)
     self->listener = listener;
     self->dealloc = dealloc;
 
+    Py_XINCREF(session);
+    self->session = session;
+
     return self;
 }
 /* }}} */
@@ -114,6 +124,7 @@ static void
 PYLIBSSH2_Listener_dealloc(PYLIBSSH2_LISTENER *self)
 {
     if (self) {
+        Py_XDECREF(self->session);
         PyObject_Del(self);
     }
 }
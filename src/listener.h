@@ -24,6 +24,8 @@
 #include <Python.h>
 #include <libssh2.h>
 
+#include "session.h"
+
 extern int init_libssh2_Listener(PyObject *);
 
 extern PyTypeObject PYLIBSSH2_Listener_Type;
@@ -32,8 +34,10 @@ extern PyTypeObject PYLIBSSH2_Listener_Type;
 
 typedef struct {
     PyObject_HEAD
-    LIBSSH2_LISTENER *listener;
-    int              dealloc;
+    LIBSSH2_LISTENER  *listener;
+    /* parent session, kept alive as long as the listener */
+    PYLIBSSH2_SESSION *session;
+    int               dealloc;
 } PYLIBSSH2_LISTENER;
 
 #endif /* _PYLIBSSH2_LISTENER_H_ */
@@ -0,0 +1,668 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <Python.h>
+#define PYLIBSSH2_MODULE
+#include "pylibssh2.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* pending[] flag telling the transport of the descriptor was read */
+#define POLLER_PUMPED 0x80000000U
+
+/* {{{ poller_grow_fds
+ *
+ * Makes the per descriptor arrays large enough to index fd.
+ */
+static int
+poller_grow_fds(PYLIBSSH2_POLLER *self, int fd)
+{
+    int i;
+    int nfds;
+    unsigned int *registered, *pending;
+    int *refs;
+
+    if (fd < self->nfds) {
+        return 0;
+    }
+
+    nfds = self->nfds ? self->nfds : 64;
+    while (nfds <= fd) {
+        nfds *= 2;
+    }
+
+    /* grow into new arrays, so a failure leaves the poller untouched */
+    registered = PyMem_Malloc(nfds * sizeof(unsigned int));
+    pending = PyMem_Malloc(nfds * sizeof(unsigned int));
+    refs = PyMem_Malloc(nfds * sizeof(int));
+    if (registered == NULL || pending == NULL || refs == NULL) {
+        PyMem_Free(registered);
+        PyMem_Free(pending);
+        PyMem_Free(refs);
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (i = 0; i < nfds; i++) {
+        if (i < self->nfds) {
+            registered[i] = self->registered[i];
+            pending[i] = self->pending[i];
+            refs[i] = self->refs[i];
+        } else {
+            registered[i] = 0;
+            pending[i] = 0;
+            refs[i] = 0;
+        }
+    }
+
+    PyMem_Free(self->registered);
+    PyMem_Free(self->pending);
+    PyMem_Free(self->refs);
+    self->registered = registered;
+    self->pending = pending;
+    self->refs = refs;
+    self->nfds = nfds;
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ poller_find
+ */
+static int
+poller_find(PYLIBSSH2_POLLER *self, PyObject *object)
+{
+    int i;
+
+    for (i = 0; i < self->nentries; i++) {
+        if (self->entries[i].object == object) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+/* }}} */
+
+/* {{{ poller_entry_ready
+ *
+ * Returns the events of an entry that are ready without waiting: a session
+ * libssh2 is not blocked on, data or EOF already queued on a channel, and
+ * room to write on a channel when libssh2 is not blocked sending.
+ */
+static int
+poller_entry_ready(PYLIBSSH2_POLLER_ENTRY *entry, int dirs)
+{
+    int ready = 0;
+    unsigned long read_avail = 0;
+    unsigned long window_size_initial = 0;
+
+    if (entry->channel == NULL) {
+        return dirs == 0 ? entry->events : 0;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(entry->session)
+    if ((entry->events & POLLER_OUT) && !(dirs & LIBSSH2_SESSION_BLOCK_OUTBOUND) &&
+        libssh2_channel_window_write(entry->channel) > 0) {
+        ready |= POLLER_OUT;
+    }
+
+    if (entry->events & POLLER_IN) {
+        libssh2_channel_window_read_ex(entry->channel, &read_avail,
+                                       &window_size_initial);
+        if (read_avail > 0 || libssh2_channel_eof(entry->channel) == 1) {
+            ready |= POLLER_IN;
+        }
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(entry->session)
+
+    return ready;
+}
+/* }}} */
+
+/* {{{ poller_pump
+ *
+ * Reads the transport of a session so that incoming packets are queued on
+ * their channels, without consuming any channel data.
+ */
+static void
+poller_pump(PYLIBSSH2_SESSION *session, LIBSSH2_CHANNEL *channel)
+{
+    int blocking;
+    char byte;
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(session)
+    blocking = libssh2_session_get_blocking(session->session);
+    libssh2_session_set_blocking(session->session, 0);
+    libssh2_channel_read_ex(channel, 0, &byte, 0);
+    libssh2_session_set_blocking(session->session, blocking);
+    PYLIBSSH2_END_ALLOW_THREADS(session)
+}
+/* }}} */
+
+/* {{{ poller_append
+ */
+static int
+poller_append(PyObject *list, PYLIBSSH2_POLLER_ENTRY *entry, int events)
+{
+    int rc;
+    PyObject *item;
+
+    item = Py_BuildValue("(Oi)", entry->data, events);
+    if (item == NULL) {
+        return -1;
+    }
+    rc = PyList_Append(list, item);
+    Py_DECREF(item);
+
+    return rc;
+}
+/* }}} */
+
+/* {{{ poller_prepare
+ *
+ * Appends to result the entries ready without waiting and updates the epoll
+ * interests from the block directions of the sessions.
+ */
+static int
+poller_prepare(PYLIBSSH2_POLLER *self, PyObject *result)
+{
+    int i, fd;
+    int dirs, events;
+    PYLIBSSH2_POLLER_ENTRY *entry;
+    struct epoll_event event;
+
+    for (i = 0; i < self->nentries; i++) {
+        entry = &self->entries[i];
+        dirs = libssh2_session_block_directions(entry->session->session);
+        events = poller_entry_ready(entry, dirs);
+        if (events && poller_append(result, entry, events) < 0) {
+            return -1;
+        }
+        if ((entry->channel != NULL && (entry->events & POLLER_IN)) ||
+            (dirs & LIBSSH2_SESSION_BLOCK_INBOUND)) {
+            self->pending[entry->fd] |= EPOLLIN;
+        }
+        if (dirs & LIBSSH2_SESSION_BLOCK_OUTBOUND) {
+            self->pending[entry->fd] |= EPOLLOUT;
+        }
+    }
+
+    for (fd = 0; fd < self->nfds; fd++) {
+        if (self->refs[fd] && self->pending[fd] != self->registered[fd]) {
+            event.events = self->pending[fd];
+            event.data.fd = fd;
+            if (epoll_ctl(self->epfd, EPOLL_CTL_MOD, fd, &event) == 0) {
+                self->registered[fd] = self->pending[fd];
+            }
+        }
+        self->pending[fd] = 0;
+    }
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ poller_collect
+ *
+ * Appends to result the entries made ready by the n descriptors reported by
+ * epoll_wait(). Incoming packets are first read from each socket.
+ */
+static int
+poller_collect(PYLIBSSH2_POLLER *self, PyObject *result, int n)
+{
+    int i, rc = 0;
+    int dirs, events;
+    unsigned int fired;
+    PYLIBSSH2_POLLER_ENTRY *entry;
+    struct epoll_event *ready = (struct epoll_event *)self->ready;
+
+    for (i = 0; i < n; i++) {
+        self->pending[ready[i].data.fd] = ready[i].events;
+    }
+
+    /* queue the incoming packets on their channels, once per socket */
+    for (i = 0; i < self->nentries; i++) {
+        entry = &self->entries[i];
+        fired = self->pending[entry->fd];
+        if (entry->channel != NULL && !(fired & POLLER_PUMPED) &&
+            (fired & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            poller_pump(entry->session, entry->channel);
+            self->pending[entry->fd] |= POLLER_PUMPED;
+        }
+    }
+
+    for (i = 0; i < self->nentries && rc == 0; i++) {
+        entry = &self->entries[i];
+        fired = self->pending[entry->fd];
+        if (fired == 0) {
+            continue;
+        }
+
+        if (entry->channel != NULL) {
+            dirs = libssh2_session_block_directions(entry->session->session);
+            events = poller_entry_ready(entry, dirs);
+        }
+        else {
+            events = 0;
+            if (fired & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                events |= POLLER_IN;
+            }
+            if (fired & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                events |= POLLER_OUT;
+            }
+        }
+        if (fired & (EPOLLERR | EPOLLHUP)) {
+            events |= entry->events;
+        }
+
+        events &= entry->events;
+        if (events) {
+            rc = poller_append(result, entry, events);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        self->pending[ready[i].data.fd] = 0;
+    }
+
+    return rc;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_register
+ */
+static char PYLIBSSH2_Poller_register_doc[] = "\n\
+register(object, [events, data]) -> None\n\
+\n\
+Watches a started Session or a Channel. Registering an object again\n\
+updates its events.\n\
+\n\
+@param object: session or channel to watch\n\
+@type  object: libssh2.Session or libssh2.Channel\n\
+@param events: mask of libssh2.POLLER_IN and libssh2.POLLER_OUT\n\
+@type  events: int\n\
+@param data: value returned by poll() in place of object\n\
+@type  data: object\n\
+\n\
+@return None";
+
+static PyObject *
+PYLIBSSH2_Poller_register(PYLIBSSH2_POLLER *self, PyObject *args)
+{
+    int i;
+    int events = POLLER_IN;
+    PyObject *object;
+    PyObject *data = NULL;
+    PYLIBSSH2_SESSION *session;
+    LIBSSH2_CHANNEL *channel = NULL;
+    PYLIBSSH2_POLLER_ENTRY *entries;
+    PYLIBSSH2_POLLER_ENTRY *entry;
+    void *ready;
+    struct epoll_event event;
+
+    if (!PyArg_ParseTuple(args, "O|iO:register", &object, &events, &data))
+        return NULL;
+
+    if (PYLIBSSH2_Session_Check(object)) {
+        session = (PYLIBSSH2_SESSION *)object;
+    }
+    else if (PYLIBSSH2_Channel_Check(object)) {
+        session = ((PYLIBSSH2_CHANNEL *)object)->session;
+        channel = ((PYLIBSSH2_CHANNEL *)object)->channel;
+    }
+    else {
+        PyErr_SetString(PyExc_TypeError, "expected a Session or a Channel");
+        return NULL;
+    }
+
+    if (session == NULL || session->fd < 0) {
+        /* CLEAN: PYLIBSSH2_SESSION_NOT_STARTED_MSG */
+        PyErr_SetString(PYLIBSSH2_Error, "Session is not started.");
+        return NULL;
+    }
+
+    if (data == NULL) {
+        data = object;
+    }
+
+    i = poller_find(self, object);
+    if (i >= 0) {
+        entry = &self->entries[i];
+        Py_INCREF(data);
+        Py_DECREF(entry->data);
+        entry->data = data;
+        entry->events = events;
+        Py_RETURN_NONE;
+    }
+
+    if (poller_grow_fds(self, session->fd) < 0) {
+        return NULL;
+    }
+
+    if (self->nentries == self->allocated) {
+        i = self->allocated ? self->allocated * 2 : 16;
+        entries = PyMem_Realloc(self->entries, i * sizeof(PYLIBSSH2_POLLER_ENTRY));
+        if (entries == NULL) {
+            return PyErr_NoMemory();
+        }
+        /* if ready fails, allocated still bounds both arrays */
+        self->entries = entries;
+        ready = PyMem_Realloc(self->ready, i * sizeof(struct epoll_event));
+        if (ready == NULL) {
+            return PyErr_NoMemory();
+        }
+        self->ready = ready;
+        self->allocated = i;
+    }
+
+    if (self->refs[session->fd] == 0) {
+        event.events = 0;
+        event.data.fd = session->fd;
+        if (epoll_ctl(self->epfd, EPOLL_CTL_ADD, session->fd, &event) < 0) {
+            return PyErr_SetFromErrno(PyExc_IOError);
+        }
+        self->registered[session->fd] = 0;
+    }
+    self->refs[session->fd]++;
+
+    entry = &self->entries[self->nentries++];
+    Py_INCREF(object);
+    entry->object = object;
+    Py_INCREF(data);
+    entry->data = data;
+    entry->session = session;
+    entry->channel = channel;
+    entry->events = events;
+    entry->fd = session->fd;
+
+    Py_RETURN_NONE;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_unregister
+ */
+static char PYLIBSSH2_Poller_unregister_doc[] = "\n\
+unregister(object) -> None\n\
+\n\
+Stops watching a Session or a Channel.\n\
+\n\
+@param object: session or channel registered\n\
+@type  object: libssh2.Session or libssh2.Channel\n\
+\n\
+@return None";
+
+static PyObject *
+PYLIBSSH2_Poller_unregister(PYLIBSSH2_POLLER *self, PyObject *args)
+{
+    int i;
+    PyObject *object;
+    PYLIBSSH2_POLLER_ENTRY entry;
+
+    if (!PyArg_ParseTuple(args, "O:unregister", &object))
+        return NULL;
+
+    i = poller_find(self, object);
+    if (i < 0) {
+        PyErr_SetObject(PyExc_KeyError, object);
+        return NULL;
+    }
+
+    entry = self->entries[i];
+    self->entries[i] = self->entries[--self->nentries];
+
+    if (--self->refs[entry.fd] == 0) {
+        /* the socket may already be closed */
+        epoll_ctl(self->epfd, EPOLL_CTL_DEL, entry.fd, NULL);
+        self->registered[entry.fd] = 0;
+    }
+
+    Py_DECREF(entry.object);
+    Py_DECREF(entry.data);
+
+    Py_RETURN_NONE;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_poll
+ */
+static char PYLIBSSH2_Poller_poll_doc[] = "\n\
+poll([timeout]) -> list\n\
+\n\
+Waits until some registered objects are ready. A session is ready when its\n\
+socket is ready in the directions libssh2 is blocked on, or right away when\n\
+libssh2 is not blocked. A channel is ready when data or EOF is queued on it\n\
+(POLLER_IN) or when its write window is open (POLLER_OUT). The sockets are\n\
+waited on with epoll, without the GIL.\n\
+\n\
+@param timeout: maximum time to wait in seconds, negative to wait forever\n\
+@type  timeout: float\n\
+\n\
+@return list of (data, events) pairs, empty on timeout\n\
+@rtype  list";
+
+static PyObject *
+PYLIBSSH2_Poller_poll(PYLIBSSH2_POLLER *self, PyObject *args)
+{
+    int n;
+    int timeout_ms = -1;
+    double timeout = -1;
+    struct timeval now, deadline;
+    PyObject *result;
+
+    if (!PyArg_ParseTuple(args, "|d:poll", &timeout))
+        return NULL;
+
+    if (timeout >= 0) {
+        timeout_ms = timeout * 1000 > INT_MAX ? INT_MAX : (int)(timeout * 1000);
+        gettimeofday(&deadline, NULL);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_usec += (timeout_ms % 1000) * 1000;
+    }
+
+    result = PyList_New(0);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    while (1) {
+        if (poller_prepare(self, result) < 0) {
+            goto error;
+        }
+        if (PyList_GET_SIZE(result) > 0 || self->nentries == 0) {
+            break;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        n = epoll_wait(self->epfd, (struct epoll_event *)self->ready,
+                       self->nentries, timeout_ms);
+        Py_END_ALLOW_THREADS
+
+        if (n < 0) {
+            if (errno != EINTR) {
+                PyErr_SetFromErrno(PyExc_IOError);
+                goto error;
+            }
+            if (PyErr_CheckSignals() < 0) {
+                goto error;
+            }
+            n = 0;
+        }
+
+        if (poller_collect(self, result, n) < 0) {
+            goto error;
+        }
+
+        /* the sockets may only have carried packets nobody waits for */
+        if (PyList_GET_SIZE(result) > 0 || timeout_ms == 0) {
+            break;
+        }
+        if (timeout_ms > 0) {
+            gettimeofday(&now, NULL);
+            timeout_ms = (deadline.tv_sec - now.tv_sec) * 1000 +
+                         (deadline.tv_usec - now.tv_usec) / 1000;
+            if (timeout_ms <= 0) {
+                break;
+            }
+        }
+    }
+
+    return result;
+
+error:
+    Py_DECREF(result);
+    return NULL;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_methods[]
+ *
+ * ADD_METHOD(name) expands to a correct PyMethodDef declaration
+ *  { 'name', (PyCFunction)PYLIBSSH2_Poller_name, METHOD_VARARGS }
+ *  for convenience
+ */
+#define ADD_METHOD(name) \
+{ #name, (PyCFunction)PYLIBSSH2_Poller_##name, METH_VARARGS, PYLIBSSH2_Poller_##name##_doc }
+
+static PyMethodDef PYLIBSSH2_Poller_methods[] =
+{
+    ADD_METHOD(register),
+    ADD_METHOD(unregister),
+    ADD_METHOD(poll),
+    { NULL, NULL }
+};
+#undef ADD_METHOD
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_New
+ */
+PYLIBSSH2_POLLER *
+PYLIBSSH2_Poller_New(void)
+{
+    PYLIBSSH2_POLLER *self;
+
+    self = PyObject_New(PYLIBSSH2_POLLER, &PYLIBSSH2_Poller_Type);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->entries = NULL;
+    self->nentries = 0;
+    self->allocated = 0;
+    self->registered = NULL;
+    self->pending = NULL;
+    self->refs = NULL;
+    self->nfds = 0;
+    self->ready = NULL;
+
+    self->epfd = epoll_create(64);
+    if (self->epfd < 0) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return self;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_dealloc
+ */
+static void
+PYLIBSSH2_Poller_dealloc(PYLIBSSH2_POLLER *self)
+{
+    int i;
+
+    for (i = 0; i < self->nentries; i++) {
+        Py_DECREF(self->entries[i].object);
+        Py_DECREF(self->entries[i].data);
+    }
+
+    if (self->epfd >= 0) {
+        close(self->epfd);
+    }
+
+    PyMem_Free(self->entries);
+    PyMem_Free(self->registered);
+    PyMem_Free(self->pending);
+    PyMem_Free(self->refs);
+    PyMem_Free(self->ready);
+
+    PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_getattr
+ */
+static PyObject *
+PYLIBSSH2_Poller_getattr(PYLIBSSH2_POLLER *self, char *name)
+{
+    return Py_FindMethod(PYLIBSSH2_Poller_methods, (PyObject *)self, name);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Poller_Type
+ *
+ * see /usr/include/python2.5/object.h line 261
+ */
+PyTypeObject PYLIBSSH2_Poller_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "Poller",                                   /* tp_name */
+    sizeof(PYLIBSSH2_POLLER),                   /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PYLIBSSH2_Poller_dealloc,       /* tp_dealloc */
+    0,                                          /* tp_print */
+    (getattrfunc)PYLIBSSH2_Poller_getattr,      /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Session and channel poller objects",       /* tp_doc */
+};
+/* }}} */
+
+/* {{{ init_libssh2_Poller
+ */
+int
+init_libssh2_Poller(PyObject *dict)
+{
+    PYLIBSSH2_Poller_Type.ob_type = &PyType_Type;
+    Py_XINCREF(&PYLIBSSH2_Poller_Type);
+    PyDict_SetItemString(dict, "PollerType", (PyObject *)&PYLIBSSH2_Poller_Type);
+
+    return 1;
+}
+/* }}} */
+
+#endif /* __linux__ */
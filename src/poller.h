@@ -0,0 +1,67 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef _PYLIBSSH2_POLLER_H_
+#define _PYLIBSSH2_POLLER_H_
+
+#include <Python.h>
+#include <libssh2.h>
+
+#include "session.h"
+
+/* readiness reported by poll() */
+#define POLLER_IN  1
+#define POLLER_OUT 2
+
+extern int init_libssh2_Poller(PyObject *);
+
+extern PyTypeObject PYLIBSSH2_Poller_Type;
+
+#define PYLIBSSH2_Poller_Check(v) ((v)->ob_type == &PYLIBSSH2_Poller_Type)
+
+typedef struct {
+    /* registered Session or Channel */
+    PyObject          *object;
+    /* returned in place of object by poll() */
+    PyObject          *data;
+    PYLIBSSH2_SESSION *session;
+    /* NULL for a session */
+    LIBSSH2_CHANNEL   *channel;
+    int               events;
+    int               fd;
+} PYLIBSSH2_POLLER_ENTRY;
+
+typedef struct {
+    PyObject_HEAD
+    int                    epfd;
+    PYLIBSSH2_POLLER_ENTRY *entries;
+    int                    nentries;
+    int                    allocated;
+    /* per descriptor state, indexed by fd */
+    unsigned int           *registered;
+    unsigned int           *pending;
+    int                    *refs;
+    int                    nfds;
+    /* epoll_wait() results, as many as entries */
+    void                   *ready;
+} PYLIBSSH2_POLLER;
+
+PYLIBSSH2_POLLER * PYLIBSSH2_Poller_New(void);
+
+#endif /* _PYLIBSSH2_POLLER_H_ */
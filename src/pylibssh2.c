@@ -38,6 +38,7 @@ method on the session instance.\n\
 /* }}} */
 
 PyObject *PYLIBSSH2_Error;
+PyObject *PYLIBSSH2_TimeoutError;
 
 /* {{{ PYLIBSSH2_Session
  */
@@ -46,9 +47,13 @@ PyDoc_STRVAR(PYLIBSSH2_Session_doc,
 This class provide SSH Session operations.\n\
 \n\
 close() -- closes the session\n\
+fileno() -- returns the socket descriptor\n\
+wait() -- waits for the socket in the blocked directions\n\
 direct_tcpip() -- tunnels a TCP connection\n\
 forward_listen() -- forwards a TCP connection\n\
 hostkey_hash() -- returns the computed digest of the remote host key\n\
+keepalive_config() -- configures keepalive messages\n\
+keepalive_send() -- sends a keepalive message if one is due\n\
 last_error() -- returns the last error in tuple format\n\
 open_session() -- allocates a new channel\n\
 scp_recv() -- requests a remote file via SCP protocol\n\
@@ -56,6 +61,8 @@ scp_send() -- sends a remote file via SCP protocol\n\
 session_method_pref() -- sets preferred methods to be negociated\n\
 session_methods() -- returns a dictionnary with the currently active algorithms\n\
 set_banner() -- sets the banner that will be sent to remote host\n\
+set_timeout() -- sets the timeout of blocking calls\n\
+get_timeout() -- returns the timeout of blocking calls\n\
 sftp_init() -- opens an SFTP Channel\n\
 startup() -- starts up the session from a socket\n\
 userauth_authenticated() -- returns authentification status\n\
@@ -88,19 +95,30 @@ This class provide SSH Channel operations.\n\
 close() -- closes the active channel\n\
 eof() -- checks if the remote host has sent an EOF status\n\
 execute() -- executes command of the channel\n\
+exec_stream() -- executes command and iterates over its output\n\
 exit_status() -- gets the exit code\n\
 flush() -- flushs the read buffer\n\
+iter_chunks() -- iterates over chunks read in recycled buffers\n\
+makefile() -- returns a buffered line-oriented reader\n\
+handle_extended_data() -- sets how stderr is handled\n\
 poll() -- polls for activity on the channel\n\
 poll_read() -- checks if data is available on the channel\n\
 pty() -- requests a pty\n\
 pty_resize() -- requests a pty resize\n\
 read() -- reads bytes on the channel\n\
+readinto() -- reads bytes on the channel into a buffer\n\
+read_all() -- reads the channel until EOF\n\
+read_streams() -- reads stdout and stderr in one pass\n\
+recv_into_fd() -- reads the channel until EOF into local files\n\
 send_eof() -- sends EOF status\n\
 setblocking() -- sets blocking mode\n\
 setenv() -- sets envrionment variable\n\
 shell() -- requests a shell\n\
 window_read() -- checks the status of the read window\n\
 write() -- writes data on a channel\n\
+sendall() -- writes all data on a channel\n\
+writev() -- writes a sequence of buffers on a channel\n\
+sendfile() -- streams a local file on a channel\n\
 x11_req() -- requests an X11 Forwarding channel\n\
 ");
 
@@ -115,7 +133,7 @@ PYLIBSSH2_Channel(PyObject *self, PyObject *args)
     }
 
     return (PyObject *)PYLIBSSH2_Channel_New(libssh2_channel_open_session(
-                        session->session), dealloc);
+                        session->session), session, dealloc);
 }
 /* }}} */
 
@@ -139,16 +157,110 @@ PYLIBSSH2_Sftp(PyObject *self, PyObject *args)
     }
 
     return (PyObject *)PYLIBSSH2_Sftp_New(libssh2_sftp_init(
-                        session->session), dealloc);
+                        session->session), session, dealloc);
 }
 /* }}} */
 
+/* {{{ PYLIBSSH2_Keepalive
+ */
+PyDoc_STRVAR(PYLIBSSH2_Keepalive_doc,
+"\n\
+This class sends the keepalive messages of many sessions from a native\n\
+background thread, at the interval libssh2 returns for each session.\n\
+\n\
+register() -- services a session\n\
+unregister() -- stops servicing a session\n\
+stop() -- stops the background thread\n\
+");
+
+static PyObject *
+PYLIBSSH2_Keepalive(PyObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ":Keepalive")) {
+        return NULL;
+    }
+
+    return (PyObject *)PYLIBSSH2_Keepalive_New();
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_run_many
+ */
+PyDoc_STRVAR(PYLIBSSH2_run_many_doc,
+"\n\
+run_many(hosts, command, [concurrency, timeout]) -> Fleet\n\
+\n\
+Runs command on every host from native worker threads: connection,\n\
+authentication, execution and collection of the output all run without\n\
+the GIL. Iterating over the returned object yields a FleetResult per\n\
+host as soon as it completes.\n\
+\n\
+@param  hosts: (host, port, username, password[, privatekey]) tuples,\n\
+        password being the passphrase of privatekey when it is given\n\
+@type   hosts: sequence\n\
+@param  command: command to execute on each host\n\
+@type   command: str\n\
+@param  concurrency: number of worker threads\n\
+@type   concurrency: int\n\
+@param  timeout: maximum time in seconds each blocking step may take,\n\
+        negative for none\n\
+@type   timeout: float\n\
+\n\
+@return iterator over the results, in completion order\n\
+@rtype  libssh2.Fleet");
+
+static PyObject *
+PYLIBSSH2_run_many(PyObject *self, PyObject *args)
+{
+    PyObject *hosts;
+    char *command;
+    int concurrency = 16;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "Os|id:run_many", &hosts, &command,
+                          &concurrency, &timeout)) {
+        return NULL;
+    }
+
+    return (PyObject *)PYLIBSSH2_Fleet_New(hosts, command, concurrency, timeout);
+}
+/* }}} */
+
+#ifdef __linux__
+/* {{{ PYLIBSSH2_Poller
+ */
+PyDoc_STRVAR(PYLIBSSH2_Poller_doc,
+"\n\
+This class waits on many sessions and channels at once with epoll.\n\
+\n\
+register() -- watches a session or a channel\n\
+unregister() -- stops watching a session or a channel\n\
+poll() -- waits for registered objects to be ready\n\
+");
+
+static PyObject *
+PYLIBSSH2_Poller(PyObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ":Poller")) {
+        return NULL;
+    }
+
+    return (PyObject *)PYLIBSSH2_Poller_New();
+}
+/* }}} */
+#endif
+
 /* {{{ PYLIBSSH2_methods[]
  */
 static PyMethodDef PYLIBSSH2_methods[] = {
     { "Session", (PyCFunction)PYLIBSSH2_Session, METH_VARARGS, PYLIBSSH2_Session_doc },
     { "Channel", (PyCFunction)PYLIBSSH2_Channel, METH_VARARGS, PYLIBSSH2_Channel_doc },
     { "Sftp", (PyCFunction)PYLIBSSH2_Sftp, METH_VARARGS, PYLIBSSH2_Sftp_doc },
+    { "Keepalive", (PyCFunction)PYLIBSSH2_Keepalive, METH_VARARGS, PYLIBSSH2_Keepalive_doc },
+    { "run_many", (PyCFunction)PYLIBSSH2_run_many, METH_VARARGS, PYLIBSSH2_run_many_doc },
+#ifdef __linux__
+    { "Poller", (PyCFunction)PYLIBSSH2_Poller, METH_VARARGS, PYLIBSSH2_Poller_doc },
+#endif
     { NULL, NULL }
 };
 /* }}} */
@@ -193,6 +305,19 @@ init_libssh2(void)
         goto error;
     }
 
+    PYLIBSSH2_TimeoutError = PyErr_NewException(
+        PYLIBSSH2_MODULE_NAME".TimeoutError",
+        PYLIBSSH2_Error,
+        NULL
+    );
+    if (PYLIBSSH2_TimeoutError == NULL) {
+        goto error;
+    }
+    Py_INCREF(PYLIBSSH2_TimeoutError);
+    if (PyModule_AddObject(module, "TimeoutError", PYLIBSSH2_TimeoutError) != 0) {
+        goto error;
+    }
+
     PyModule_AddIntConstant(module, "FINGERPRINT_MD5", 0x0000);
     PyModule_AddIntConstant(module, "FINGERPRINT_SHA1", 0x0001);
     PyModule_AddIntConstant(module, "FINGERPRINT_HEX", 0x0000);
@@ -211,6 +336,15 @@ init_libssh2(void)
     PyModule_AddIntConstant(module, "SFTP_READLINK", LIBSSH2_SFTP_READLINK);
     PyModule_AddIntConstant(module, "SFTP_REALPATH", LIBSSH2_SFTP_REALPATH);
 
+    PyModule_AddIntConstant(module, "CHANNEL_EXTENDED_DATA_NORMAL", LIBSSH2_CHANNEL_EXTENDED_DATA_NORMAL);
+    PyModule_AddIntConstant(module, "CHANNEL_EXTENDED_DATA_IGNORE", LIBSSH2_CHANNEL_EXTENDED_DATA_IGNORE);
+    PyModule_AddIntConstant(module, "CHANNEL_EXTENDED_DATA_MERGE", LIBSSH2_CHANNEL_EXTENDED_DATA_MERGE);
+
+    PyModule_AddIntConstant(module, "STREAM_EXIT_STATUS", CHANNELSTREAM_EXIT_STATUS);
+
+    PyModule_AddIntConstant(module, "POLLER_IN", POLLER_IN);
+    PyModule_AddIntConstant(module, "POLLER_OUT", POLLER_OUT);
+
     PyModule_AddIntConstant(module, "SFTP_STAT", LIBSSH2_SFTP_STAT);
     PyModule_AddIntConstant(module, "SFTP_LSTAT", LIBSSH2_SFTP_LSTAT);
     
@@ -224,12 +358,38 @@ init_libssh2(void)
     if (!init_libssh2_Channel(dict)) {
         goto error;
     }
+    if (!init_libssh2_ChannelFile(dict)) {
+        goto error;
+    }
+    if (!init_libssh2_ChannelChunks(dict)) {
+        goto error;
+    }
+    if (!init_libssh2_ChannelStream(dict)) {
+        goto error;
+    }
+    if (!init_libssh2_Listener(dict)) {
+        goto error;
+    }
+    if (!init_libssh2_Fleet(dict)) {
+        goto error;
+    }
+    if (!init_libssh2_Keepalive(dict)) {
+        goto error;
+    }
+#ifdef __linux__
+    if (!init_libssh2_Poller(dict)) {
+        goto error;
+    }
+#endif
     if (!init_libssh2_Sftp(dict)) {
         goto error;
     }
     if (!init_libssh2_Sftphandle(dict)) {
         goto error;
     }
+    if (!init_libssh2_SftpDir(dict)) {
+        goto error;
+    }
 
     error:
     ;
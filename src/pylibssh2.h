@@ -28,8 +28,15 @@
 #include <libssh2_publickey.h>
 
 #include "channel.h"
+#include "channelfile.h"
+#include "channelchunks.h"
+#include "channelstream.h"
+#include "fleet.h"
+#include "keepalive.h"
 #include "listener.h"
+#include "poller.h"
 #include "sftp.h"
+#include "sftpdir.h"
 #include "sftphandle.h"
 #include "session.h"
 #include "util.h"
@@ -43,6 +50,9 @@
 /* Python module's Error */
 extern PyObject *PYLIBSSH2_Error;
 
+/* raised by calls which exceed their timeout */
+extern PyObject *PYLIBSSH2_TimeoutError;
+
 #ifdef exception_from_error_queue
 #   undef exception_from_error_queue
 #endif
@@ -58,19 +68,19 @@ extern PyObject *PYLIBSSH2_Error;
 
 #define PYLIBSSH2_Channel_New_NUM        1
 #define PYLIBSSH2_Channel_New_RETURN     PYLIBSSH2_CHANNEL *
-#define PYLIBSSH2_Channel_New_PROTO      (LIBSSH2_CHANNEL *, int)
+#define PYLIBSSH2_Channel_New_PROTO      (LIBSSH2_CHANNEL *, PYLIBSSH2_SESSION *, int)
 
 #define PYLIBSSH2_Sftp_New_NUM           2
 #define PYLIBSSH2_Sftp_New_RETURN        PYLIBSSH2_SFTP *
-#define PYLIBSSH2_Sftp_New_PROTO         (LIBSSH2_SFTP *, int)
+#define PYLIBSSH2_Sftp_New_PROTO         (LIBSSH2_SFTP *, PYLIBSSH2_SESSION *, int)
 
 #define PYLIBSSH2_Sftphandle_New_NUM     3
 #define PYLIBSSH2_Sftphandle_New_RETURN  PYLIBSSH2_SFTPHANDLE *
-#define PYLIBSSH2_Sftphandle_New_PROTO   (LIBSSH2_SFTP_HANDLE *, int)
+#define PYLIBSSH2_Sftphandle_New_PROTO   (LIBSSH2_SFTP_HANDLE *, PYLIBSSH2_SFTP *, int)
 
 #define PYLIBSSH2_Listener_New_NUM       4
 #define PYLIBSSH2_Listener_New_RETURN    PYLIBSSH2_LISTENER *
-#define PYLIBSSH2_Listener_New_PROTO     (LIBSSH2_LISTENER *, int)
+#define PYLIBSSH2_Listener_New_PROTO     (LIBSSH2_LISTENER *, PYLIBSSH2_SESSION *, int)
 
 #define PYLIBSSH2_API_pointers           5
 
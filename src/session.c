@@ -22,6 +22,132 @@
 #define PYLIBSSH2_MODULE
 #include "pylibssh2.h"
 
+/* {{{ session_would_block
+ *
+ * Returns 1 when the last call on the session failed only because it would
+ * block (non blocking mode). Must be called with the session lock held, as
+ * another thread may overwrite the error once it is released.
+ */
+static int
+session_would_block(PYLIBSSH2_SESSION *self)
+{
+    return libssh2_session_last_errno(self->session) == LIBSSH2_ERROR_EAGAIN;
+}
+/* }}} */
+
+/* {{{ session_lock
+ *
+ * Must be called without the GIL, see PYLIBSSH2_BEGIN_ALLOW_THREADS.
+ */
+void
+session_lock(PYLIBSSH2_SESSION *self)
+{
+    if (self != NULL && self->lock != NULL) {
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    }
+}
+/* }}} */
+
+/* {{{ session_unlock
+ */
+void
+session_unlock(PYLIBSSH2_SESSION *self)
+{
+    if (self != NULL && self->lock != NULL) {
+        PyThread_release_lock(self->lock);
+    }
+}
+/* }}} */
+
+/* {{{ session_timeout_begin
+ *
+ * Applies a per call timeout in seconds, negative to keep the session
+ * timeout. Called with the session lock held, session_timeout_end() must
+ * be called before it is released. Returns the value to give back to
+ * session_timeout_end().
+ */
+long
+session_timeout_begin(PYLIBSSH2_SESSION *self, double timeout)
+{
+    long previous;
+    long timeout_ms;
+
+    if (self == NULL || timeout < 0) {
+        return -1;
+    }
+
+    /* libssh2 takes 0 as no timeout at all */
+    timeout_ms = (long)(timeout * 1000);
+    if (timeout_ms < 1) {
+        timeout_ms = 1;
+    }
+
+    previous = self->timeout;
+    libssh2_session_set_timeout(self->session, timeout_ms);
+
+    return previous;
+}
+/* }}} */
+
+/* {{{ session_timeout_end
+ *
+ * Restores the session timeout, which set_timeout() may only change while
+ * no per call timeout is applied.
+ */
+void
+session_timeout_end(PYLIBSSH2_SESSION *self, long previous)
+{
+    if (self != NULL && previous >= 0) {
+        libssh2_session_set_timeout(self->session, self->timeout);
+    }
+}
+/* }}} */
+
+/* {{{ session_timeout_error
+ *
+ * Raises libssh2.TimeoutError for a call which returned
+ * LIBSSH2_ERROR_TIMEOUT.
+ */
+PyObject *
+session_timeout_error(void)
+{
+    /* CLEAN: PYLIBSSH2_TIMEOUT_MSG */
+    PyErr_SetString(PYLIBSSH2_TimeoutError, "Operation timed out.");
+    return NULL;
+}
+/* }}} */
+
+/* {{{ session_error
+ *
+ * Raises libssh2.Error with the libssh2 error code of the failed call in
+ * its code attribute, so that callers do not have to read it back from a
+ * session other threads may be using.
+ */
+static PyObject *
+session_error(int rc, const char *message)
+{
+    PyObject *error;
+    PyObject *code;
+
+    error = PyObject_CallFunction(PYLIBSSH2_Error, "s", message);
+    if (error == NULL) {
+        return NULL;
+    }
+
+    code = PyInt_FromLong(rc);
+    if (code == NULL || PyObject_SetAttrString(error, "code", code) < 0) {
+        Py_XDECREF(code);
+        Py_DECREF(error);
+        return NULL;
+    }
+    Py_DECREF(code);
+
+    PyErr_SetObject(PYLIBSSH2_Error, error);
+    Py_DECREF(error);
+    return NULL;
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Session_set_banner
  */
 static char PYLIBSSH2_Session_set_banner_doc[] = "\
@@ -73,7 +199,9 @@ PYLIBSSH2_Session_setblocking(PYLIBSSH2_SESSION *self, PyObject *args)
         return NULL;
     }
 
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     libssh2_session_set_blocking(self->session, mode);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
     
     return Py_BuildValue("");
 }
@@ -94,7 +222,9 @@ PYLIBSSH2_Session_getblocking(PYLIBSSH2_SESSION *self, PyObject *args)
 {
     int mode;
 
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     mode = libssh2_session_get_blocking(self->session);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
     
     return Py_BuildValue("i", mode);
 }
@@ -124,6 +254,202 @@ PYLIBSSH2_Session_blockdirections(PYLIBSSH2_SESSION *self, PyObject *args)
 /* }}} */
 
 
+/* {{{ PYLIBSSH2_Session_set_timeout
+ */
+static char PYLIBSSH2_Session_set_timeout_doc[] = "\
+set_timeout(timeout) -> None\n\
+\n\
+Sets the maximum time blocking calls on the session may wait. Calls which\n\
+time out raise libssh2.TimeoutError.\n\
+\n\
+@param  timeout: timeout in seconds, 0 to wait forever\n\
+@type   timeout: float\n\
+\n\
+@return None";
+
+static PyObject *
+PYLIBSSH2_Session_set_timeout(PYLIBSSH2_SESSION *self, PyObject *args)
+{
+    double timeout;
+    long timeout_ms = 0;
+
+    if (!PyArg_ParseTuple(args, "d:set_timeout", &timeout)) {
+        return NULL;
+    }
+
+    /* a short timeout must not round down to 0, which waits forever */
+    if (timeout > 0) {
+        timeout_ms = (long)(timeout * 1000);
+        if (timeout_ms < 1) {
+            timeout_ms = 1;
+        }
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
+    self->timeout = timeout_ms;
+    libssh2_session_set_timeout(self->session, self->timeout);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
+    Py_RETURN_NONE;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Session_get_timeout
+ */
+static char PYLIBSSH2_Session_get_timeout_doc[] = "\
+get_timeout() -> float\n\
+\n\
+Returns the maximum time blocking calls on the session may wait.\n\
+\n\
+@return timeout in seconds, 0 if calls wait forever\n\
+@rtype  float";
+
+static PyObject *
+PYLIBSSH2_Session_get_timeout(PYLIBSSH2_SESSION *self, PyObject *args)
+{
+    return Py_BuildValue("d", self->timeout / 1000.0);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Session_keepalive_config
+ */
+static char PYLIBSSH2_Session_keepalive_config_doc[] = "\
+keepalive_config(want_reply, interval) -> None\n\
+\n\
+Configures the keepalive messages sent by keepalive_send().\n\
+\n\
+@param  want_reply: whether the server should answer keepalive messages\n\
+@type   want_reply: int\n\
+@param  interval: seconds of idle time before a keepalive message is due,\n\
+        0 to disable keepalives\n\
+@type   interval: int\n\
+\n\
+@return None";
+
+static PyObject *
+PYLIBSSH2_Session_keepalive_config(PYLIBSSH2_SESSION *self, PyObject *args)
+{
+    int want_reply;
+    unsigned int interval;
+
+    if (!PyArg_ParseTuple(args, "iI:keepalive_config", &want_reply, &interval)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
+    libssh2_keepalive_config(self->session, want_reply, interval);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
+    Py_RETURN_NONE;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Session_keepalive_send
+ */
+static char PYLIBSSH2_Session_keepalive_send_doc[] = "\
+keepalive_send() -> int\n\
+\n\
+Sends a keepalive message if one is due.\n\
+\n\
+@return seconds until the next keepalive message is due, 0 if keepalives\n\
+        are disabled, or LIBSSH2_ERROR_EAGAIN if it would block (non\n\
+        blocking mode)\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Session_keepalive_send(PYLIBSSH2_SESSION *self, PyObject *args)
+{
+    int rc;
+    int seconds_to_next = 0;
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
+    rc = libssh2_keepalive_send(self->session, &seconds_to_next);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
+    if (rc == LIBSSH2_ERROR_EAGAIN) {
+        return Py_BuildValue("i", rc);
+    }
+
+    if (rc < 0) {
+        /* CLEAN: PYLIBSSH2_CANT_SEND_KEEPALIVE_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to send keepalive message (error %d).", rc);
+        return NULL;
+    }
+
+    return Py_BuildValue("i", seconds_to_next);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Session_fileno
+ */
+static char PYLIBSSH2_Session_fileno_doc[] = "\
+fileno() -> int\n\
+\n\
+Returns the descriptor of the socket the session was started up with.\n\
+\n\
+@return socket descriptor\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Session_fileno(PYLIBSSH2_SESSION *self, PyObject *args)
+{
+    if (self->fd < 0) {
+        /* CLEAN: PYLIBSSH2_SESSION_NOT_STARTED_MSG */
+        PyErr_SetString(PYLIBSSH2_Error, "Session is not started.");
+        return NULL;
+    }
+
+    return Py_BuildValue("i", self->fd);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Session_wait
+ */
+static char PYLIBSSH2_Session_wait_doc[] = "\
+wait([timeout]) -> int\n\
+\n\
+Waits until the session socket is ready in the directions libssh2 is\n\
+blocked on. Returns immediately if libssh2 is not blocked.\n\
+\n\
+@param  timeout: maximum time to wait in seconds, negative to wait forever\n\
+@type   timeout: float\n\
+\n\
+@return 1 when the socket is ready, 0 on timeout\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Session_wait(PYLIBSSH2_SESSION *self, PyObject *args)
+{
+    int rc;
+    int timeout_ms = -1;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "|d:wait", &timeout)) {
+        return NULL;
+    }
+
+    if (self->fd < 0) {
+        /* CLEAN: PYLIBSSH2_SESSION_NOT_STARTED_MSG */
+        PyErr_SetString(PYLIBSSH2_Error, "Session is not started.");
+        return NULL;
+    }
+
+    if (timeout >= 0) {
+        timeout_ms = timeout * 1000 > INT_MAX ? INT_MAX : (int)(timeout * 1000);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rc = wait_socket(self->session, self->fd, timeout_ms);
+    Py_END_ALLOW_THREADS
+
+    if (rc < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    return Py_BuildValue("i", rc > 0);
+}
+/* }}} */
+
 
 /* {{{ PYLIBSSH2_Session_startup
  */
@@ -150,12 +476,23 @@ PYLIBSSH2_Session_startup(PYLIBSSH2_SESSION *self, PyObject *args)
         return NULL;
     }
 
-    Py_XINCREF(socket);
-    self->socket = socket;
     fd = PyObject_AsFileDescriptor(socket);
-    Py_BEGIN_ALLOW_THREADS
+    if (fd < 0) {
+        return NULL;
+    }
+
+    Py_INCREF(socket);
+    Py_XDECREF(self->socket);
+    self->socket = socket;
+    self->fd = fd;
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     rc = libssh2_session_handshake(self->session, fd);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
         libssh2_session_last_error(self->session, &last_error, NULL, 0);
@@ -195,9 +532,9 @@ PYLIBSSH2_Session_close(PYLIBSSH2_SESSION *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     rc = libssh2_session_disconnect(self->session, reason);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
         /* CLEAN: PYLIBSSH2_SESSION_CLOSE_MSG */
@@ -254,7 +591,9 @@ PYLIBSSH2_Session_userauth_list(PYLIBSSH2_SESSION *self, PyObject *args)
         return NULL;
     }
 
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     auth_list=libssh2_userauth_list(self->session, username, username_len);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
     if (auth_list == NULL) {
        PyErr_SetString(PYLIBSSH2_Error, "Authentication methods listing failed.");
        return NULL;
@@ -287,9 +626,9 @@ PYLIBSSH2_Session_hostkey_hash(PYLIBSSH2_SESSION *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     hash = libssh2_hostkey_hash(self->session, hashtype);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     if (hash == NULL) {
         Py_INCREF(Py_None);
@@ -325,9 +664,13 @@ PYLIBSSH2_Session_userauth_password(PYLIBSSH2_SESSION *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "ss:userauth_password", &username, &password))
         return NULL;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     rc = libssh2_userauth_password_ex(self->session, username, strlen(username), password, strlen(password), NULL);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
         /* CLEAN: PYLIBSSH2_SESSION_USERAUTH_PASSWORD_FAILED_MSG */
@@ -374,10 +717,10 @@ PYLIBSSH2_Session_userauth_publickey_fromfile(PYLIBSSH2_SESSION *self, PyObject
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     rc = libssh2_userauth_publickey_fromfile(self->session, username, publickey,
                                              privatekey, passphrase);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
         libssh2_session_last_error(self->session, &last_error, NULL, 0);
@@ -418,8 +761,8 @@ PYLIBSSH2_Session_userauth_agent(PYLIBSSH2_SESSION *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    //printf("[DEBUG] userauth_agent(): Py_BEGIN_ALLOW_THREADS\n");
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
+    //printf("[DEBUG] userauth_agent(): PYLIBSSH2_BEGIN_ALLOW_THREADS(self)\n");
     agent = libssh2_agent_init(self->session);
     if (!agent) {
         error_message = "Failure initializing ssh-agent support";
@@ -460,8 +803,8 @@ shutdown:
         libssh2_agent_free(agent);
     }
 
-    Py_END_ALLOW_THREADS
-    //printf("[DEBUG] userauth_agent(): Py_END_ALLOW_THREADS\n");
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+    //printf("[DEBUG] userauth_agent(): PYLIBSSH2_END_ALLOW_THREADS(self)\n");
 
     if (rc) {
         libssh2_session_last_error(self->session, &last_error, NULL, 0);
@@ -576,26 +919,31 @@ static PyObject *
 PYLIBSSH2_Session_open_session(PYLIBSSH2_SESSION *self, PyObject *args)
 {
     int dealloc = 1;
+    int rc = 0;
     LIBSSH2_CHANNEL *channel;
 
     if (!PyArg_ParseTuple(args, "|i:open_session", &dealloc)) {
         return NULL;
     }
 
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     channel = libssh2_channel_open_session(self->session);
-    
+    if (channel == NULL) {
+        rc = libssh2_session_last_errno(self->session);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
     if (channel== NULL){
-      if (libssh2_session_last_error(self->session,NULL,NULL,0) ==
-	  LIBSSH2_ERROR_EAGAIN){
+      if (rc == LIBSSH2_ERROR_EAGAIN){
 	return Py_BuildValue("");
 	}
       else{
-	PyErr_SetString(PYLIBSSH2_Error, "Failed to open channel");
-	return NULL;
+	/* CLEAN: PYLIBSSH2_SESSION_OPEN_CHANNEL_MSG */
+	return session_error(rc, "Failed to open channel");
       }
     }
     else {
-      return (PyObject *)PYLIBSSH2_Channel_New(channel, dealloc);
+      return (PyObject *)PYLIBSSH2_Channel_New(channel, self, dealloc);
     }
 }
 /* }}} */
@@ -610,27 +958,35 @@ Requests a remote file via SCP protocol.\n\
 @param  remote_path: absolute path of remote file to transfer\n\
 @type   remote_path: str\n\
 \n\
-@return new channel opened\n\
-@rtype  libssh2.Channel";
+@return new channel opened or None if it would block (non blocking mode)\n\
+@rtype  libssh2.Channel or None";
 
 static PyObject *
 PYLIBSSH2_Session_scp_recv(PYLIBSSH2_SESSION *self, PyObject *args)
 {
     char *path;
     LIBSSH2_CHANNEL *channel;
+    int would_block;
 
     if (!PyArg_ParseTuple(args, "s:scp_recv", &path)) {
         return NULL;
     }
 
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     channel = libssh2_scp_recv(self->session, path, NULL);
+    would_block = channel == NULL && session_would_block(self);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
     if (channel == NULL) {
+        if (would_block) {
+            Py_RETURN_NONE;
+        }
         /* CLEAN: PYLIBSSH2_CHANNEL_SCP_RECV_ERROR_MSG */
         PyErr_SetString(PYLIBSSH2_Error, "SCP receive error.");
         return NULL;
     }
     
-    return (PyObject *)PYLIBSSH2_Channel_New(channel, 1);
+    return (PyObject *)PYLIBSSH2_Channel_New(channel, self, 1);
 }
 /* }}} */
 
@@ -648,8 +1004,8 @@ Sends a file to remote host via SCP protocol.\n\
 @param size: size of file being transmitted\n\
 @type  size: int\n\
 \n\
-@return new channel opened\n\
-@rtype  libssh2.Channel";
+@return new channel opened or None if it would block (non blocking mode)\n\
+@rtype  libssh2.Channel or None";
 
 static PyObject *
 PYLIBSSH2_Session_scp_send(PYLIBSSH2_SESSION *self, PyObject *args)
@@ -658,19 +1014,27 @@ PYLIBSSH2_Session_scp_send(PYLIBSSH2_SESSION *self, PyObject *args)
     int mode;
     unsigned long filesize;
     LIBSSH2_CHANNEL *channel;
+    int would_block;
 
     if (!PyArg_ParseTuple(args, "sik:scp_send", &path, &mode, &filesize)) {
         return NULL;
     }
 
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     channel = libssh2_scp_send(self->session, path, mode, filesize);
+    would_block = channel == NULL && session_would_block(self);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
     if (channel == NULL) {
+        if (would_block) {
+            Py_RETURN_NONE;
+        }
         /* CLEAN: PYLIBSSH2_CHANNEL_SCP_SEND_ERROR_MSG */
         PyErr_SetString(PYLIBSSH2_Error, "SCP send error.");
         return NULL;
     }
 
-    return (PyObject *)PYLIBSSH2_Channel_New(channel, 1);
+    return (PyObject *)PYLIBSSH2_Channel_New(channel, self, 1);
 }
 /* }}} */
 
@@ -681,19 +1045,36 @@ sftp_init() -> libssh2.Sftp\n\
 \n\
 Opens an SFTP Channel.\n\
 \n\
-@return new opened SFTP channel\n\
-@rtype  libssh2.Sftp";
+@return new opened SFTP channel or None if it would block (non blocking\n\
+        mode)\n\
+@rtype  libssh2.Sftp or None";
 
 static PyObject *
 PYLIBSSH2_Session_sftp_init(PYLIBSSH2_SESSION *self, PyObject *args)
 {
     int dealloc = 1;
+    LIBSSH2_SFTP *sftp;
+    int would_block;
 
     if (!PyArg_ParseTuple(args, "|i:sftp_init", &dealloc)) {
         return NULL;
     }
 
-    return (PyObject *)PYLIBSSH2_Sftp_New(libssh2_sftp_init(self->session), dealloc);
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
+    sftp = libssh2_sftp_init(self->session);
+    would_block = sftp == NULL && session_would_block(self);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
+
+    if (sftp == NULL) {
+        if (would_block) {
+            Py_RETURN_NONE;
+        }
+        /* CLEAN: PYLIBSSH2_SESSION_SFTP_INIT_ERROR_MSG */
+        PyErr_SetString(PYLIBSSH2_Error, "Unable to start SFTP subsystem.");
+        return NULL;
+    }
+
+    return (PyObject *)PYLIBSSH2_Sftp_New(sftp, self, dealloc);
 }
 /* }}} */
 
@@ -713,8 +1094,8 @@ Tunnels a TCP connection through an SSH Session.\n\
 @param  sport: local port\n\
 @type   sport: int\n\
 \n\
-@return new opened channel\n\
-@rtype  libssh2.Channel";
+@return new opened channel or None if it would block (non blocking mode)\n\
+@rtype  libssh2.Channel or None";
 
 static PyObject *
 PYLIBSSH2_Session_direct_tcpip(PYLIBSSH2_SESSION *self, PyObject *args)
@@ -728,24 +1109,27 @@ PYLIBSSH2_Session_direct_tcpip(PYLIBSSH2_SESSION *self, PyObject *args)
     /* remote port */
     int port;
     LIBSSH2_CHANNEL *channel;
-    char *last_error = "";
+    int would_block;
 
     if (!PyArg_ParseTuple(args, "si|si:direct_tcpip", &host, &port, &shost, &sport)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     channel = libssh2_channel_direct_tcpip_ex(self->session, host, port, shost, sport);
-    Py_END_ALLOW_THREADS
+    would_block = channel == NULL && session_would_block(self);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     if (channel == NULL) {
-        libssh2_session_last_error(self->session, &last_error, NULL, 0);
+        if (would_block) {
+            Py_RETURN_NONE;
+        }
         /* CLEAN: PYLIBSSH2_SESSION_TCP_CONNECT_ERROR_MSG */
         PyErr_SetString(PYLIBSSH2_Error, "Unable to create TCP connection.");
         return NULL;
     }
 
-    return (PyObject *)channel;
+    return (PyObject *)PYLIBSSH2_Channel_New(channel, self, 1);
 }
 /* }}} */
 
@@ -760,13 +1144,14 @@ Forwards a TCP connection through an SSH Session.\n\
 @type   host: str\n\
 @param  port: remote port\n\
 @type   port: int\n\
-@param  bound_port: populated with the actual port on the remote host\n\
+@param  bound_port: ignored, kept for compatibility\n\
 @type   bound_port: int\n\
 @param  queue_maxsize: maximum number of pending connections\n\
 @type   int\n\
 \n\
-@return new libssh2.Listener instance on succes or None on failure\n\
-@rtype  libssh2.Listener";
+@return new libssh2.Listener instance or None if it would block (non\n\
+        blocking mode)\n\
+@rtype  libssh2.Listener or None";
 
 static PyObject *
 PYLIBSSH2_Session_forward_listen(PYLIBSSH2_SESSION *self, PyObject *args)
@@ -774,26 +1159,31 @@ PYLIBSSH2_Session_forward_listen(PYLIBSSH2_SESSION *self, PyObject *args)
     char *host;
     int port;
     int queue_maxsize;
-    int *bound_port;
+    int bound_port;
     LIBSSH2_LISTENER *listener;
+    int would_block;
 
     if (!PyArg_ParseTuple(args, "siii:forward_listen", &host, &port,
                           &bound_port, &queue_maxsize)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     listener = libssh2_channel_forward_listen_ex(self->session, host, port,
-                                                 bound_port, queue_maxsize);
-    Py_END_ALLOW_THREADS
+                                                 &bound_port, queue_maxsize);
+    would_block = listener == NULL && session_would_block(self);
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     if (listener == NULL) {
+        if (would_block) {
+            Py_RETURN_NONE;
+        }
         /* CLEAN: PYLIBSSH2_SESSION_TCP_CONNECT_ERROR_MSG */
         PyErr_SetString(PYLIBSSH2_Error, "Unable to forward listen connection.");
         return NULL;
     }
 
-    return (PyObject *)PYLIBSSH2_Listener_New(listener, 0);
+    return (PyObject *)PYLIBSSH2_Listener_New(listener, self, 0);
 }
 /* }}} */
 
@@ -813,9 +1203,9 @@ PYLIBSSH2_Session_last_error(PYLIBSSH2_SESSION *self, PyObject *args)
     char *errmsg;
     int rc,want_buf=0;
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     rc=libssh2_session_last_error(self->session, &errmsg, NULL, want_buf);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     return Py_BuildValue("(i,s)", rc, errmsg);
 }
@@ -865,11 +1255,13 @@ stub_callback_func(LIBSSH2_SESSION *session,
     pysession->session = session;
     pysession->opened = 1;
     pysession->dealloc = 0;
+    pysession->socket = NULL;
+    pysession->fd = -1;
+    /* the lock is already held by the call running this callback */
+    pysession->lock = NULL;
     Py_INCREF(pysession);
 
-    pychannel = PyObject_New(PYLIBSSH2_CHANNEL, &PYLIBSSH2_Channel_Type);
-    pychannel->channel = channel;
-    pychannel->dealloc = 0;
+    pychannel = PYLIBSSH2_Channel_New(channel, pysession, 0);
     Py_INCREF(pychannel);
 
     pyabstract = Py_None;
@@ -916,9 +1308,9 @@ PYLIBSSH2_Session_callback_set(PYLIBSSH2_SESSION *self, PyObject *args)
         Py_XINCREF(py_callback_func);
         py_callback_func = cb;
 
-        Py_BEGIN_ALLOW_THREADS
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
         libssh2_session_callback_set(self->session, cbtype, stub_callback_func);
-        Py_END_ALLOW_THREADS
+        PYLIBSSH2_END_ALLOW_THREADS(self)
 
         Py_INCREF(Py_None);
         result = Py_None;
@@ -949,9 +1341,9 @@ PYLIBSSH2_Session_set_trace(PYLIBSSH2_SESSION *self, PyObject *args)
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     libssh2_trace(self->session, bitmask);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     return Py_BuildValue("i", rc);
 }
@@ -1010,9 +1402,9 @@ PYLIBSSH2_Session_userauth_keyboardinteractive(PYLIBSSH2_SESSION *self, PyObject
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self)
     rc = libssh2_userauth_keyboard_interactive(self->session, username, &stub_kbd_callback_func);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_END_ALLOW_THREADS(self)
 
     if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
         PyErr_SetString(PYLIBSSH2_Error, "Authentication by keyboard-interactive failed.");
@@ -1040,7 +1432,13 @@ static PyMethodDef PYLIBSSH2_Session_methods[] =
     ADD_METHOD(set_banner),
     ADD_METHOD(setblocking),
     ADD_METHOD(getblocking),
+    ADD_METHOD(set_timeout),
+    ADD_METHOD(get_timeout),
+    ADD_METHOD(keepalive_config),
+    ADD_METHOD(keepalive_send),
     ADD_METHOD(blockdirections),
+    ADD_METHOD(fileno),
+    ADD_METHOD(wait),
     ADD_METHOD(startup),
     ADD_METHOD(close),
     ADD_METHOD(userauth_authenticated),
@@ -1083,6 +1481,16 @@ PYLIBSSH2_Session_New(LIBSSH2_SESSION *session, int dealloc)
     self->dealloc = dealloc;
     self->opened = 0;
     self->socket = NULL;
+    self->fd = -1;
+    self->timeout = libssh2_session_get_timeout(session);
+
+    self->lock = PyThread_allocate_lock();
+    if (self->lock == NULL) {
+        self->dealloc = 0;
+        Py_DECREF(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
 
     libssh2_banner_set(session, LIBSSH2_SSH_DEFAULT_BANNER " Python");
 
@@ -1106,6 +1514,10 @@ PYLIBSSH2_Session_dealloc(PYLIBSSH2_SESSION *self)
     Py_XDECREF(self->socket);
     self->socket = NULL;
 
+    if (self->lock != NULL) {
+        PyThread_free_lock(self->lock);
+    }
+
     if (self) {
         PyObject_Del(self);
     }
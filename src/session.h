@@ -22,6 +22,7 @@
 #define _PYLIBSSH2_SESSION_H_
 
 #include <Python.h>
+#include <pythread.h>
 #include <libssh2.h>
 
 extern int init_libssh2_Session(PyObject *);
@@ -34,8 +35,36 @@ typedef struct {
     PyObject_HEAD
     LIBSSH2_SESSION *session;
     PyObject        *socket;
+    /* descriptor of socket, -1 until startup */
+    int             fd;
     int             dealloc;
     int             opened;
+    /* serializes libssh2 calls, NULL for borrowed sessions */
+    PyThread_type_lock lock;
+    /* session timeout in ms, restored after each per call timeout */
+    long            timeout;
 } PYLIBSSH2_SESSION;
 
+/*
+ * libssh2 sessions are not thread safe. Calls into libssh2 on a session or
+ * on its channels, listeners and sftp objects run between these macros,
+ * used in place of Py_BEGIN/END_ALLOW_THREADS: the session lock is taken
+ * once the GIL is released, so a thread waiting for it never blocks the
+ * interpreter.
+ */
+#define PYLIBSSH2_BEGIN_ALLOW_THREADS(s) \
+    Py_BEGIN_ALLOW_THREADS \
+    session_lock(s);
+
+#define PYLIBSSH2_END_ALLOW_THREADS(s) \
+    session_unlock(s); \
+    Py_END_ALLOW_THREADS
+
+void session_lock(PYLIBSSH2_SESSION *);
+void session_unlock(PYLIBSSH2_SESSION *);
+
+long session_timeout_begin(PYLIBSSH2_SESSION *, double);
+void session_timeout_end(PYLIBSSH2_SESSION *, long);
+PyObject * session_timeout_error(void);
+
 #endif /* _PYLIBSSH2_SESSION_H_ */
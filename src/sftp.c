@@ -19,6 +19,11 @@
  * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 #include <Python.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #define PYLIBSSH2_MODULE
 #include "pylibssh2.h"
 
@@ -47,6 +52,24 @@ get_attrs(LIBSSH2_SFTP_ATTRIBUTES *attr)
 }
 /* }}} */
 
+/* {{{ sftp_shut_down
+ *
+ * Returns 1 with a Python exception set once the sftp channel is shut
+ * down.
+ */
+int
+sftp_shut_down(PYLIBSSH2_SFTP *self)
+{
+    if (self->sftp == NULL) {
+        /* CLEAN: PYLIBSSH2_SFTP_SHUT_DOWN_MSG */
+        PyErr_SetString(PYLIBSSH2_Error, "Sftp channel is shut down.");
+        return 1;
+    }
+
+    return 0;
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Sftp_close
  */
 static char PYLIBSSH2_Sftp_close_doc[] = "\n\
@@ -63,13 +86,14 @@ PYLIBSSH2_Sftp_close(PYLIBSSH2_SFTP *self, PyObject *args)
     int rc;
     PYLIBSSH2_SFTPHANDLE *handle;
 
-    if (!PyArg_ParseTuple(args, "O:close", &handle)) {
+    if (!PyArg_ParseTuple(args, "O!:close", &PYLIBSSH2_Sftphandle_Type,
+                          &handle)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_close_handle(handle->sftphandle);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    rc = sftphandle_close(handle);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc) {
         /* CLEAN: PYLIBSSH2_SFTPHANDLE_CANT_CLOSE_MSG */
@@ -93,16 +117,37 @@ Returns:\n\
 static PyObject *
 PYLIBSSH2_Sftp_opendir(PYLIBSSH2_SFTP *self, PyObject *args)
 {
-    LIBSSH2_SFTP_HANDLE *handle;
+    int rc = 0;
+    LIBSSH2_SFTP_HANDLE *handle = NULL;
     char *path;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "s:opendir", &path)) {
+    if (!PyArg_ParseTuple(args, "s|d:opendir", &path, &timeout)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    handle = libssh2_sftp_opendir(self->sftp, path);
-    Py_END_ALLOW_THREADS
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp != NULL) {
+        saved = session_timeout_begin(self->session, timeout);
+        handle = libssh2_sftp_opendir(self->sftp, path);
+        if (handle == NULL)
+            rc = libssh2_session_last_errno(self->session->session);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (handle == NULL) {
         /* CLEAN: PYLIBSSH2_SFTPHANDLE_CANT_OPENDIR_MSG */
@@ -110,7 +155,7 @@ PYLIBSSH2_Sftp_opendir(PYLIBSSH2_SFTP *self, PyObject *args)
         return NULL;
     }
 
-    return (PyObject *)PYLIBSSH2_Sftphandle_New(handle, 1);
+    return (PyObject *)PYLIBSSH2_Sftphandle_New(handle, self, 1);
 }
 /* }}} */
 
@@ -132,8 +177,15 @@ PYLIBSSH2_Sftp_readdir(PYLIBSSH2_SFTP *self, PyObject *args)
     int longentry_maxlen = 255;
     PyObject *buffer;
     PyObject *list;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "O:readdir", &handle)) {
+    if (!PyArg_ParseTuple(args, "O!|d:readdir", &PYLIBSSH2_Sftphandle_Type,
+                          &handle, &timeout)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(handle)) {
         return NULL;
     }
 
@@ -143,10 +195,27 @@ PYLIBSSH2_Sftp_readdir(PYLIBSSH2_SFTP *self, PyObject *args)
         return Py_None;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    buffer_maxlen = libssh2_sftp_readdir(handle->sftphandle, PyString_AsString(buffer),
-                                         longentry_maxlen, &attrs);
-    Py_END_ALLOW_THREADS
+    handle->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp != NULL) {
+        saved = session_timeout_begin(self->session, timeout);
+        buffer_maxlen = libssh2_sftp_readdir(handle->sftphandle,
+                                             PyString_AsString(buffer),
+                                             longentry_maxlen, &attrs);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+    handle->busy = 0;
+
+    if (sftp_shut_down(self)) {
+        Py_DECREF(buffer);
+        return NULL;
+    }
+
+    if (buffer_maxlen == LIBSSH2_ERROR_TIMEOUT) {
+        Py_DECREF(buffer);
+        return session_timeout_error();
+    }
 
     if (buffer_maxlen == 0) {
         Py_INCREF(Py_None);
@@ -191,7 +260,12 @@ PYLIBSSH2_Sftp_listdir(PYLIBSSH2_SFTP *self, PyObject *args)
     PyObject *all = NULL;
     PyObject *list = NULL;
 
-    if (!PyArg_ParseTuple(args, "O:listdir", &handle)) {
+    if (!PyArg_ParseTuple(args, "O!:listdir", &PYLIBSSH2_Sftphandle_Type,
+                          &handle)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(handle)) {
         return NULL;
     }
 
@@ -203,10 +277,20 @@ PYLIBSSH2_Sftp_listdir(PYLIBSSH2_SFTP *self, PyObject *args)
             return Py_None;
         }
 
-        Py_BEGIN_ALLOW_THREADS
-        buffer_maxlen = libssh2_sftp_readdir(handle->sftphandle, 
-            PyString_AsString(buffer), longentry_maxlen, &attrs);
-        Py_END_ALLOW_THREADS
+        handle->busy = 1;
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+        if (self->sftp != NULL) {
+            buffer_maxlen = libssh2_sftp_readdir(handle->sftphandle,
+                PyString_AsString(buffer), longentry_maxlen, &attrs);
+        }
+        PYLIBSSH2_END_ALLOW_THREADS(self->session)
+        handle->busy = 0;
+
+        if (sftp_shut_down(self)) {
+            Py_DECREF(buffer);
+            Py_DECREF(all);
+            return NULL;
+        }
 
         if (buffer_maxlen == 0) { 
             break; 
@@ -231,6 +315,70 @@ PYLIBSSH2_Sftp_listdir(PYLIBSSH2_SFTP *self, PyObject *args)
 }
 /* }}} */
 
+/* {{{ PYLIBSSH2_Sftp_scandir
+ */
+static char PYLIBSSH2_Sftp_scandir_doc[] = "\n\
+scandir(path) -> iterator\n\
+\n\
+Lists a directory lazily. Entries are read from the server as the\n\
+iterator advances, without name length limit, and \".\" and \"..\" are\n\
+skipped.\n\
+\n\
+@param path: path of the remote directory\n\
+@type  path: str\n\
+\n\
+@return iterator of SftpDirEntry (name, size, uid, gid, perms, atime,\n\
+        mtime), attributes the server did not send being None\n\
+@rtype  iterator";
+
+static PyObject *
+PYLIBSSH2_Sftp_scandir(PYLIBSSH2_SFTP *self, PyObject *args)
+{
+    int rc = 0;
+    char *path;
+    LIBSSH2_SFTP_HANDLE *handle;
+    PYLIBSSH2_SFTPDIR *dir;
+
+    if (!PyArg_ParseTuple(args, "s:scandir", &path)) {
+        return NULL;
+    }
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    do {
+        handle = libssh2_sftp_opendir(self->sftp, path);
+        if (handle == NULL)
+            rc = libssh2_session_last_errno(self->session->session);
+    } while (handle == NULL && rc == LIBSSH2_ERROR_EAGAIN &&
+             (rc = wait_session(self->session->session,
+                                self->session->fd)) == 0);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (handle == NULL) {
+        /* CLEAN: PYLIBSSH2_SFTPHANDLE_CANT_OPENDIR_MSG */
+        PyErr_Format(PYLIBSSH2_Error,
+                     "Unable to open sftp directory (error %d).", rc);
+        return NULL;
+    }
+
+    dir = PYLIBSSH2_SftpDir_New(handle, self);
+    if (dir == NULL) {
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+        libssh2_sftp_close_handle(handle);
+        PYLIBSSH2_END_ALLOW_THREADS(self->session)
+    }
+
+    return (PyObject *)dir;
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Sftp_open
  */
 static char PYLIBSSH2_Sftp_open_doc[] = "\n\
@@ -243,18 +391,40 @@ Returns:\n\
 static PyObject *
 PYLIBSSH2_Sftp_open(PYLIBSSH2_SFTP *self, PyObject *args)
 {
-    LIBSSH2_SFTP_HANDLE *handle;
+    int rc = 0;
+    LIBSSH2_SFTP_HANDLE *handle = NULL;
     char *path;
     char *flags = "r";
     long mode = 0755;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "s|sid:open", &path, &flags, &mode,
+                          &timeout)) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTuple(args, "s|si:open", &path, &flags, &mode)) {
+    if (sftp_shut_down(self)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    handle = libssh2_sftp_open(self->sftp, path, get_flags(flags), mode);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp != NULL) {
+        saved = session_timeout_begin(self->session, timeout);
+        handle = libssh2_sftp_open(self->sftp, path, get_flags(flags), mode);
+        if (handle == NULL)
+            rc = libssh2_session_last_errno(self->session->session);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (handle == NULL) {
         /* CLEAN: PYLIBSSH2_SFTP_CANT_OPEN_MSG */
@@ -262,7 +432,7 @@ PYLIBSSH2_Sftp_open(PYLIBSSH2_SFTP *self, PyObject *args)
         return NULL;
     }
 
-    return (PyObject *)PYLIBSSH2_Sftphandle_New(handle, 1);
+    return (PyObject *)PYLIBSSH2_Sftphandle_New(handle, self, 1);
     
 }
 /* }}} */
@@ -281,7 +451,17 @@ PYLIBSSH2_Sftp_shutdown(PYLIBSSH2_SFTP *self, PyObject *args)
 {
     int rc;
 
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
     rc=libssh2_sftp_shutdown(self->sftp);
+    /* the sftp channel is freed, handles check for NULL under the lock */
+    if (rc == 0) {
+        self->sftp = NULL;
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
 
     if (rc == -1) {
         /* CLEAN: PYLIBSSH2_SFTP_CANT_SHUTDOWN_MSG */
@@ -296,21 +476,37 @@ PYLIBSSH2_Sftp_shutdown(PYLIBSSH2_SFTP *self, PyObject *args)
 /* {{{ PYLIBSSH2_Sftp_read
  */
 static char PYLIBSSH2_Sftp_read_doc[] = "\n\
+read(handle, size, [timeout]) -> str\n\
 \n\
-Arguments:\n\
+Reads size bytes from an opened file.\n\
 \n\
-Returns:\n\
-";
+@param handle: handle of the opened file\n\
+@type  handle: libssh2.Sftphandle\n\
+@param size: maximum number of bytes to read\n\
+@type  size: int\n\
+@param timeout: maximum time in seconds the call may block, negative for\n\
+        the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return bytes read or None at end of file or on failure\n\
+@rtype  str or None";
 
 static PyObject *
 PYLIBSSH2_Sftp_read(PYLIBSSH2_SFTP *self, PyObject *args)
 {
     int rc;
     int buffer_maxlen;
+    long saved;
+    double timeout = -1;
     PyObject *buffer;
     PYLIBSSH2_SFTPHANDLE *handle;
 
-    if (!PyArg_ParseTuple(args, "Oi:read", &handle, &buffer_maxlen)) {
+    if (!PyArg_ParseTuple(args, "O!i|d:read", &PYLIBSSH2_Sftphandle_Type,
+                          &handle, &buffer_maxlen, &timeout)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(handle) || sftphandle_sync(handle) < 0) {
         return NULL;
     }
 
@@ -320,10 +516,33 @@ PYLIBSSH2_Sftp_read(PYLIBSSH2_SFTP *self, PyObject *args)
         return Py_None;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_read(handle->sftphandle, PyString_AsString(buffer),
-                           buffer_maxlen);
-    Py_END_ALLOW_THREADS
+    handle->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_read(handle->sftphandle, PyString_AsString(buffer),
+                               buffer_maxlen);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+    handle->busy = 0;
+
+    if (sftp_shut_down(self)) {
+        Py_DECREF(buffer);
+        return NULL;
+    }
+
+    if (rc > 0) {
+        handle->offset += rc;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        Py_DECREF(buffer);
+        return session_timeout_error();
+    }
 
     if (rc > 0) {
         if ( rc != buffer_maxlen && _PyString_Resize(&buffer, rc) < 0) {
@@ -340,29 +559,148 @@ PYLIBSSH2_Sftp_read(PYLIBSSH2_SFTP *self, PyObject *args)
 }
 /* }}} */
 
+/* {{{ PYLIBSSH2_Sftp_readinto
+ */
+static char PYLIBSSH2_Sftp_readinto_doc[] = "\n\
+readinto(handle, buffer, [timeout]) -> int\n\
+\n\
+Reads bytes from an opened file directly into a writable buffer.\n\
+\n\
+@param handle: handle of the opened file\n\
+@type  handle: libssh2.Sftphandle\n\
+@param buffer: preallocated storage (bytearray, memoryview, mmap...)\n\
+@type  buffer: writable buffer\n\
+@param timeout: maximum time in seconds the call may block, negative for\n\
+        the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return number of bytes stored in buffer, 0 at end of file or\n\
+        LIBSSH2_ERROR_EAGAIN if it would block (non blocking mode)\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Sftp_readinto(PYLIBSSH2_SFTP *self, PyObject *args)
+{
+    ssize_t rc;
+    /* caller-owned storage, filled in place */
+    Py_buffer buffer;
+    long saved;
+    double timeout = -1;
+    PYLIBSSH2_SFTPHANDLE *handle;
+
+    if (!PyArg_ParseTuple(args, "O!w*|d:readinto", &PYLIBSSH2_Sftphandle_Type,
+                          &handle, &buffer, &timeout)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(handle) || sftphandle_sync(handle) < 0) {
+        PyBuffer_Release(&buffer);
+        return NULL;
+    }
+
+    if (buffer.len == 0) {
+        PyBuffer_Release(&buffer);
+        return Py_BuildValue("i", 0);
+    }
+
+    handle->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_read(handle->sftphandle, buffer.buf, buffer.len);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+    handle->busy = 0;
+
+    PyBuffer_Release(&buffer);
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc > 0) {
+        handle->offset += rc;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (rc < 0 && rc != LIBSSH2_ERROR_EAGAIN) {
+        /* CLEAN: PYLIBSSH2_SFTP_CANT_READ_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read sftp (error %d).",
+                     (int)rc);
+        return NULL;
+    }
+
+    return Py_BuildValue("n", (Py_ssize_t)rc);
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Sftp_write
  */
 static char PYLIBSSH2_Sftp_write_doc[] = "\n\
+write(handle, data, [timeout]) -> int\n\
 \n\
-Arguments:\n\
+Writes data to an opened file.\n\
 \n\
-Returns:\n\
-";
+@param handle: handle of the opened file\n\
+@type  handle: libssh2.Sftphandle\n\
+@param data: bytes to write\n\
+@type  data: str\n\
+@param timeout: maximum time in seconds the call may block, negative for\n\
+        the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return number of bytes written\n\
+@rtype  int";
 
 static PyObject *
 PYLIBSSH2_Sftp_write(PYLIBSSH2_SFTP *self, PyObject *args)
 {
     int rc, buffer_len;
+    long saved;
+    double timeout = -1;
     char *buffer;
     PYLIBSSH2_SFTPHANDLE *handle;
 
-    if (!PyArg_ParseTuple(args, "Os#:write", &handle, &buffer, &buffer_len)) {
+    if (!PyArg_ParseTuple(args, "O!s#|d:write", &PYLIBSSH2_Sftphandle_Type,
+                          &handle, &buffer, &buffer_len, &timeout)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_write(handle->sftphandle, buffer, buffer_len);
-    Py_END_ALLOW_THREADS
+    if (sftphandle_closed(handle) || sftphandle_sync(handle) < 0) {
+        return NULL;
+    }
+
+    handle->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_write(handle->sftphandle, buffer, buffer_len);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+    handle->busy = 0;
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc > 0) {
+        handle->offset += rc;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc < 0) {
         /* CLEAN: PYLIBSSH2_Sftp_CANT_WRITE_MSG */
@@ -375,6 +713,383 @@ PYLIBSSH2_Sftp_write(PYLIBSSH2_SFTP *self, PyObject *args)
 }
 /* }}} */
 
+/* {{{ PYLIBSSH2_Sftp_get
+ */
+static char PYLIBSSH2_Sftp_get_doc[] = "\n\
+get(remote_path, local, [chunk_size, max_outstanding, timeout]) -> int\n\
+\n\
+Downloads a remote file to a local file, with the GIL released once for\n\
+the whole transfer. Reads go through a buffer of chunk_size *\n\
+max_outstanding bytes, which libssh2 splits into read requests of at most\n\
+30000 bytes sent ahead of the data, and the results are written in order.\n\
+With the default chunk_size, max_outstanding requests are kept in flight.\n\
+\n\
+@param remote_path: path of the remote file\n\
+@type  remote_path: str\n\
+@param local: path of the local file to create or truncate, local file\n\
+        descriptor or file object\n\
+@type  local: str or int or file\n\
+@param chunk_size: bytes of the read buffer per request, requests are\n\
+        capped at 30000 bytes by libssh2\n\
+@type  chunk_size: int\n\
+@param max_outstanding: number of chunks in the read buffer\n\
+@type  max_outstanding: int\n\
+@param timeout: maximum time in seconds each libssh2 call may block,\n\
+        negative for the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return number of bytes downloaded\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Sftp_get(PYLIBSSH2_SFTP *self, PyObject *args)
+{
+    int fd;
+    int rc = 0;
+    int write_errno = 0;
+    long saved;
+    double timeout = -1;
+    char *path;
+    char *buffer;
+    size_t buffer_len;
+    Py_ssize_t chunk_size = 30000;
+    Py_ssize_t max_outstanding = 16;
+    PY_LONG_LONG count = 0;
+    PyObject *local;
+    LIBSSH2_SFTP_HANDLE *handle;
+
+    if (!PyArg_ParseTuple(args, "sO|nnd:get", &path, &local, &chunk_size,
+                          &max_outstanding, &timeout))
+        return NULL;
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (chunk_size <= 0 || max_outstanding <= 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "chunk_size and max_outstanding must be positive");
+        return NULL;
+    }
+    if (chunk_size > PY_SSIZE_T_MAX / max_outstanding) {
+        return PyErr_NoMemory();
+    }
+
+    if (PyString_Check(local)) {
+        fd = open(PyString_AsString(local), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return PyErr_SetFromErrnoWithFilename(PyExc_IOError,
+                                                  PyString_AsString(local));
+        }
+    }
+    else {
+        fd = PyObject_AsFileDescriptor(local);
+        if (fd < 0) {
+            return NULL;
+        }
+    }
+
+    /*
+     * libssh2_sftp_read() splits a read into requests of at most 30000
+     * bytes and sends them ahead of the data asked for, so a buffer of
+     * max_outstanding chunks keeps that many requests on the wire.
+     */
+    buffer_len = chunk_size * max_outstanding;
+    buffer = PyMem_Malloc(buffer_len);
+    if (buffer == NULL) {
+        if (PyString_Check(local))
+            close(fd);
+        return PyErr_NoMemory();
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    do {
+        handle = libssh2_sftp_open(self->sftp, path, LIBSSH2_FXF_READ, 0);
+        if (handle == NULL)
+            rc = libssh2_session_last_errno(self->session->session);
+    } while (handle == NULL && rc == LIBSSH2_ERROR_EAGAIN &&
+             (rc = wait_session(self->session->session,
+                                self->session->fd)) == 0);
+    if (handle != NULL) {
+        while (1) {
+            rc = libssh2_sftp_read(handle, buffer, buffer_len);
+            if (rc > 0) {
+                if (write_all(fd, buffer, rc) < 0) {
+                    write_errno = errno;
+                    break;
+                }
+                count += rc;
+            }
+            else if (rc != LIBSSH2_ERROR_EAGAIN ||
+                     (rc = wait_session(self->session->session,
+                                        self->session->fd)) < 0) {
+                break;
+            }
+        }
+        while (libssh2_sftp_close_handle(handle) == LIBSSH2_ERROR_EAGAIN &&
+               wait_session(self->session->session,
+                            self->session->fd) == 0)
+            ;
+    }
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    PyMem_Free(buffer);
+    if (PyString_Check(local) && close(fd) < 0 && !write_errno) {
+        write_errno = errno;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (handle == NULL) {
+        /* CLEAN: PYLIBSSH2_SFTP_CANT_OPEN_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to sftp open (error %d).", rc);
+        return NULL;
+    }
+
+    if (write_errno) {
+        errno = write_errno;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    if (rc < 0) {
+        /* CLEAN: PYLIBSSH2_SFTP_CANT_READ_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to read sftp (error %d).", rc);
+        return NULL;
+    }
+
+    return PyLong_FromLongLong(count);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftp_put
+ */
+static char PYLIBSSH2_Sftp_put_doc[] = "\n\
+put(local, remote_path, [chunk_size, max_outstanding, mode, timeout]) -> int\n\
+\n\
+Uploads a local file to a remote file, created or truncated, with the GIL\n\
+released once for the whole transfer, from the current offset of the\n\
+local file to its end. Regular files are mapped in memory, other\n\
+descriptors are read. Writes go through windows of chunk_size *\n\
+max_outstanding bytes, which libssh2 splits into write requests of at\n\
+most 30000 bytes. With the default chunk_size, max_outstanding requests\n\
+are kept in flight.\n\
+\n\
+@param local: path of the local file, local file descriptor or file object\n\
+@type  local: str or int or file\n\
+@param remote_path: path of the remote file\n\
+@type  remote_path: str\n\
+@param chunk_size: bytes of the write window per request, requests are\n\
+        capped at 30000 bytes by libssh2\n\
+@type  chunk_size: int\n\
+@param max_outstanding: number of chunks in the write window\n\
+@type  max_outstanding: int\n\
+@param mode: permissions of the remote file when created\n\
+@type  mode: int\n\
+@param timeout: maximum time in seconds each libssh2 call may block,\n\
+        negative for the session timeout\n\
+@type  timeout: float\n\
+\n\
+@return number of bytes uploaded\n\
+@rtype  int";
+
+/*
+ * Writes len bytes at the current offset of handle, returning the number
+ * of bytes acknowledged. libssh2_sftp_write() sends the whole buffer ahead
+ * and returns as soon as the first requests are acknowledged, in order: it
+ * must be called again with the buffer advanced by the returned count.
+ */
+ssize_t
+sftp_write_all(PYLIBSSH2_SFTP *self, LIBSSH2_SFTP_HANDLE *handle,
+               const char *buffer, size_t len, int *rc)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = libssh2_sftp_write(handle, buffer + done, len - done);
+        if (n > 0) {
+            done += n;
+        }
+        else if (n != LIBSSH2_ERROR_EAGAIN ||
+                 (n = wait_session(self->session->session,
+                                   self->session->fd)) < 0) {
+            *rc = n ? (int)n : LIBSSH2_ERROR_SOCKET_SEND;
+            break;
+        }
+    }
+
+    return done;
+}
+
+static PyObject *
+PYLIBSSH2_Sftp_put(PYLIBSSH2_SFTP *self, PyObject *args)
+{
+    int fd;
+    int rc = 0;
+    int rc_close;
+    int read_errno = 0;
+    long saved;
+    long mode = 0644;
+    long page_size;
+    double timeout = -1;
+    char *path;
+    char *buffer = NULL;
+    char *map = MAP_FAILED;
+    char *data = NULL;
+    size_t buffer_len;
+    size_t map_len = 0;
+    size_t data_len = 0;
+    off_t start;
+    off_t map_start;
+    ssize_t n;
+    Py_ssize_t chunk_size = 30000;
+    Py_ssize_t max_outstanding = 16;
+    PY_LONG_LONG count = 0;
+    PyObject *local;
+    LIBSSH2_SFTP_HANDLE *handle;
+    struct stat st;
+
+    if (!PyArg_ParseTuple(args, "Os|nnld:put", &local, &path, &chunk_size,
+                          &max_outstanding, &mode, &timeout))
+        return NULL;
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (chunk_size <= 0 || max_outstanding <= 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "chunk_size and max_outstanding must be positive");
+        return NULL;
+    }
+    if (chunk_size > PY_SSIZE_T_MAX / max_outstanding) {
+        return PyErr_NoMemory();
+    }
+    buffer_len = chunk_size * max_outstanding;
+
+    if (PyString_Check(local)) {
+        fd = open(PyString_AsString(local), O_RDONLY);
+        if (fd < 0) {
+            return PyErr_SetFromErrnoWithFilename(PyExc_IOError,
+                                                  PyString_AsString(local));
+        }
+    }
+    else {
+        fd = PyObject_AsFileDescriptor(local);
+        if (fd < 0) {
+            return NULL;
+        }
+    }
+
+    /* regular files are sent from their mapping, the rest goes through a
+       bounce buffer; the mapping starts at the page holding the current
+       offset */
+    start = lseek(fd, 0, SEEK_CUR);
+    if (start >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > start) {
+        page_size = sysconf(_SC_PAGESIZE);
+        map_start = start - start % page_size;
+        map_len = st.st_size - map_start;
+        map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, map_start);
+        data = map + (start - map_start);
+        data_len = st.st_size - start;
+    }
+    if (map == MAP_FAILED) {
+        buffer = PyMem_Malloc(buffer_len);
+        if (buffer == NULL) {
+            if (PyString_Check(local))
+                close(fd);
+            return PyErr_NoMemory();
+        }
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    saved = session_timeout_begin(self->session, timeout);
+    do {
+        handle = libssh2_sftp_open(self->sftp, path, get_flags("w"), mode);
+        if (handle == NULL)
+            rc = libssh2_session_last_errno(self->session->session);
+    } while (handle == NULL && rc == LIBSSH2_ERROR_EAGAIN &&
+             (rc = wait_session(self->session->session,
+                                self->session->fd)) == 0);
+    if (handle != NULL) {
+        rc = 0;
+        if (map != MAP_FAILED) {
+            madvise(map, map_len, MADV_SEQUENTIAL);
+            /* feed libssh2 one window at a time so that no more than
+               max_outstanding requests are queued */
+            while (!rc && (size_t)count < data_len) {
+                n = data_len - count;
+                if ((size_t)n > buffer_len)
+                    n = buffer_len;
+                count += sftp_write_all(self, handle, data + count, n, &rc);
+            }
+            /* leave the local offset after the data sent, as read() does */
+            lseek(fd, start + count, SEEK_SET);
+        }
+        else {
+            while (!rc) {
+                n = read(fd, buffer, buffer_len);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0) {
+                    read_errno = n < 0 ? errno : 0;
+                    break;
+                }
+                count += sftp_write_all(self, handle, buffer, n, &rc);
+            }
+        }
+        /* the server may only report a failed write when the file is
+           closed */
+        while ((rc_close = libssh2_sftp_close_handle(handle)) ==
+               LIBSSH2_ERROR_EAGAIN &&
+               (rc_close = wait_session(self->session->session,
+                                        self->session->fd)) == 0)
+            ;
+        if (!rc) {
+            rc = rc_close;
+        }
+    }
+    session_timeout_end(self->session, saved);
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (map != MAP_FAILED)
+        munmap(map, map_len);
+    PyMem_Free(buffer);
+    if (PyString_Check(local))
+        close(fd);
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    if (handle == NULL) {
+        /* CLEAN: PYLIBSSH2_SFTP_CANT_OPEN_MSG */
+        PyErr_Format(PYLIBSSH2_Error, "Unable to sftp open (error %d).", rc);
+        return NULL;
+    }
+
+    if (read_errno) {
+        errno = read_errno;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    if (rc < 0) {
+        /* CLEAN: PYLIBSSH2_Sftp_CANT_WRITE_MSG */
+        PyErr_Format(PYLIBSSH2_Error,
+                     "Unable to write sftp at offset %lld (error %d).",
+                     count, rc);
+        return NULL;
+    }
+
+    return PyLong_FromLongLong(count);
+}
+/* }}} */
+
 /* {{{ PYLIBSSH2_Sftp_tell
  */
 static char PYLIBSSH2_Sftp_tell_doc[] = "\n\
@@ -389,11 +1104,17 @@ PYLIBSSH2_Sftp_tell(PYLIBSSH2_SFTP *self, PyObject *args)
 {
     PYLIBSSH2_SFTPHANDLE *handle;
 
-    if (!PyArg_ParseTuple(args, "O:tell", &handle)) {
+    if (!PyArg_ParseTuple(args, "O!:tell", &PYLIBSSH2_Sftphandle_Type,
+                          &handle)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(handle)) {
         return NULL;
     }
 
-    return PyInt_FromLong(libssh2_sftp_tell(handle->sftphandle));
+    /* the remote position is ahead of the caller by the read-ahead */
+    return PyLong_FromUnsignedLongLong(handle->offset);
 }
 /* }}} */
 
@@ -412,13 +1133,27 @@ PYLIBSSH2_Sftp_seek(PYLIBSSH2_SFTP *self, PyObject *args)
     PYLIBSSH2_SFTPHANDLE *handle;
     unsigned long offset=0;
 
-    if (!PyArg_ParseTuple(args, "Ok:seek", &handle, &offset)) {
+    if (!PyArg_ParseTuple(args, "O!k:seek", &PYLIBSSH2_Sftphandle_Type,
+                          &handle, &offset)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    libssh2_sftp_seek(handle->sftphandle, offset);
-    Py_END_ALLOW_THREADS
+    if (sftphandle_closed(handle) || sftphandle_sync(handle) < 0) {
+        return NULL;
+    }
+
+    handle->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp != NULL) {
+        libssh2_sftp_seek(handle->sftphandle, offset);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+    handle->busy = 0;
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+    handle->offset = offset;
 
     return PyInt_FromLong(1);
 }
@@ -439,14 +1174,35 @@ PYLIBSSH2_Sftp_unlink(PYLIBSSH2_SFTP *self, PyObject *args)
 
     int rc;
     char *path;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "s:unlink", &path)) {
+    if (!PyArg_ParseTuple(args, "s|d:unlink", &path, &timeout)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_unlink(self->sftp, path);
-    Py_END_ALLOW_THREADS
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_unlink(self->sftp, path);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     return Py_BuildValue("i", rc);
 }
@@ -466,14 +1222,35 @@ PYLIBSSH2_Sftp_rename(PYLIBSSH2_SFTP *self, PyObject *args)
 {
     int rc;
     char *src, *dst;
-    
-    if (!PyArg_ParseTuple(args, "ss:rename", &src, &dst)) {
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "ss|d:rename", &src, &dst, &timeout)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_rename(self->sftp, src, dst);
-    Py_END_ALLOW_THREADS
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_rename(self->sftp, src, dst);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     return Py_BuildValue("i", rc);
 }
@@ -494,14 +1271,35 @@ PYLIBSSH2_Sftp_mkdir(PYLIBSSH2_SFTP *self, PyObject *args)
     int rc;
     char *path;
     long mode = 0755;
-    
-    if (!PyArg_ParseTuple(args, "s|i:mkdir", &path, &mode)) {
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "s|id:mkdir", &path, &mode, &timeout)) {
+        return NULL;
+    }
+
+    if (sftp_shut_down(self)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_mkdir(self->sftp, path, mode);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_mkdir(self->sftp, path, mode);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     return Py_BuildValue("i", rc);
 }
@@ -521,14 +1319,35 @@ PYLIBSSH2_Sftp_rmdir(PYLIBSSH2_SFTP *self, PyObject *args)
 {
     int rc;
     char *path;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "s:rmdir", &path)) {
+    if (!PyArg_ParseTuple(args, "s|d:rmdir", &path, &timeout)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_rmdir(self->sftp, path);
-    Py_END_ALLOW_THREADS
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_rmdir(self->sftp, path);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     return Py_BuildValue("i", rc);
 }
@@ -550,8 +1369,15 @@ PYLIBSSH2_Sftp_realpath(PYLIBSSH2_SFTP *self, PyObject *args)
     int type = LIBSSH2_SFTP_REALPATH;
     char *path;
     PyObject *target;
+    long saved;
+    double timeout = -1;
 
-    if (!PyArg_ParseTuple(args, "s#|i:realpath", &path, &path_len, &type)) {
+    if (!PyArg_ParseTuple(args, "s#|id:realpath", &path, &path_len, &type,
+                          &timeout)) {
+        return NULL;
+    }
+
+    if (sftp_shut_down(self)) {
         return NULL;
     }
 
@@ -561,10 +1387,27 @@ PYLIBSSH2_Sftp_realpath(PYLIBSSH2_SFTP *self, PyObject *args)
         return Py_None;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_symlink_ex(self->sftp, path, path_len, 
-            PyString_AsString(target), target_len, type);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_symlink_ex(self->sftp, path, path_len, 
+                PyString_AsString(target), target_len, type);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        Py_DECREF(target);
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        Py_DECREF(target);
+        return session_timeout_error();
+    }
 
     if (rc > 0) {
         if (rc != target_len && _PyString_Resize(&target, rc) < 0) {
@@ -595,14 +1438,35 @@ PYLIBSSH2_Sftp_symlink(PYLIBSSH2_SFTP *self, PyObject *args)
 {
     int rc;
     char *path, *target;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "ss|d:symlink", &path, &target, &timeout)) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTuple(args, "ss:symlink", &path, &target)) {
+    if (sftp_shut_down(self)) {
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_symlink(self->sftp, path, target);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_symlink(self->sftp, path, target);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc == -1) {
         /* CLEAN: PYLIBSSH2_SFTP_CANT_SYMLINK_MSG */
@@ -631,14 +1495,36 @@ PYLIBSSH2_Sftp_get_stat(PYLIBSSH2_SFTP *self, PyObject *args)
     int path_len = 0;
     int type = LIBSSH2_SFTP_STAT;
     LIBSSH2_SFTP_ATTRIBUTES attr;
-    
-    if (!PyArg_ParseTuple(args, "s#|i:get_stat", &path, &path_len, &type)) {
-        return NULL; 
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "s#|id:get_stat", &path, &path_len, &type,
+                          &timeout)) {
+        return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_stat_ex(self->sftp, path, path_len, type, &attr);
-    Py_END_ALLOW_THREADS
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_stat_ex(self->sftp, path, path_len, type, &attr);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc == -1) {
         /* CLEAN: PYLIBSSH2_SFTP_CANT_GETSTAT_MSG */
@@ -666,8 +1552,14 @@ PYLIBSSH2_Sftp_set_stat(PYLIBSSH2_SFTP *self, PyObject *args)
     char *path;
     LIBSSH2_SFTP_ATTRIBUTES attr;
     PyObject *attrs;
+    long saved;
+    double timeout = -1;
+
+    if (!PyArg_ParseTuple(args, "sO|d:set_stat", &path, &attrs, &timeout)) {
+        return NULL;
+    }
 
-    if (!PyArg_ParseTuple(args, "sO:set_stat", &path, &attrs)) {
+    if (sftp_shut_down(self)) {
         return NULL;
     }
 
@@ -701,9 +1593,24 @@ PYLIBSSH2_Sftp_set_stat(PYLIBSSH2_SFTP *self, PyObject *args)
         }
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    rc = libssh2_sftp_setstat(self->sftp, path, &attr);
-    Py_END_ALLOW_THREADS
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->session)
+    if (self->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        saved = session_timeout_begin(self->session, timeout);
+        rc = libssh2_sftp_setstat(self->sftp, path, &attr);
+        session_timeout_end(self->session, saved);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->session)
+
+    if (sftp_shut_down(self)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
 
     if (rc == -1) {
         PyErr_SetString(PYLIBSSH2_Error, "Unable to stat.");
@@ -729,10 +1636,14 @@ static PyMethodDef PYLIBSSH2_Sftp_methods[] =
     ADD_METHOD(opendir),
     ADD_METHOD(readdir),
     ADD_METHOD(listdir),
+    ADD_METHOD(scandir),
     ADD_METHOD(open),
     ADD_METHOD(shutdown),
     ADD_METHOD(read),
+    ADD_METHOD(readinto),
     ADD_METHOD(write),
+    ADD_METHOD(get),
+    ADD_METHOD(put),
     ADD_METHOD(tell),
     ADD_METHOD(seek),
     ADD_METHOD(unlink),
@@ -752,7 +1663,7 @@ static PyMethodDef PYLIBSSH2_Sftp_methods[] =
 /* {{{ PYLIBSSH2_Sftp_New
  */
 PYLIBSSH2_SFTP *
-PYLIBSSH2_Sftp_New(LIBSSH2_SFTP *sftp, int dealloc)
+PYLIBSSH2_Sftp_New(LIBSSH2_SFTP *sftp, PYLIBSSH2_SESSION *session, int dealloc)
 {
     PYLIBSSH2_SFTP *self;
 
@@ -764,6 +1675,9 @@ PYLIBSSH2_Sftp_New(LIBSSH2_SFTP *sftp, int dealloc)
     self->sftp = sftp;
     self->dealloc = dealloc;
 
+    Py_XINCREF(session);
+    self->session = session;
+
     return self;
 }
 /* }}} */
@@ -773,6 +1687,8 @@ PYLIBSSH2_Sftp_New(LIBSSH2_SFTP *sftp, int dealloc)
 static void
 PYLIBSSH2_Sftp_dealloc(PYLIBSSH2_SFTP *self)
 {
+    Py_XDECREF(self->session);
+
     PyObject_Del(self);
 }
 /* }}} */
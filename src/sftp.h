@@ -23,6 +23,9 @@
 
 #include <Python.h>
 #include <libssh2.h>
+#include <libssh2_sftp.h>
+
+#include "session.h"
 
 extern int init_libssh2_Sftp(PyObject *);
 
@@ -32,8 +35,18 @@ extern PyTypeObject PYLIBSSH2_Sftp_Type;
 
 typedef struct {
     PyObject_HEAD
+    /* NULL once shut down, the handles left open are unusable */
     LIBSSH2_SFTP    *sftp;
+    /* parent session, kept alive as long as the sftp channel */
+    PYLIBSSH2_SESSION *session;
     int             dealloc;
 } PYLIBSSH2_SFTP;
 
+PyObject * get_attrs(LIBSSH2_SFTP_ATTRIBUTES *);
+
+int sftp_shut_down(PYLIBSSH2_SFTP *);
+
+ssize_t sftp_write_all(PYLIBSSH2_SFTP *, LIBSSH2_SFTP_HANDLE *, const char *,
+                       size_t, int *);
+
 #endif /* _PYLIBSSH2_SFTP_H_ */
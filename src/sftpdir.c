@@ -0,0 +1,305 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#include <Python.h>
+#include <string.h>
+#define PYLIBSSH2_MODULE
+#include "pylibssh2.h"
+
+/* {{{ PYLIBSSH2_SftpDirEntry_Type
+ */
+static PyStructSequence_Field sftpdir_entry_fields[] = {
+    { "name", "file name" },
+    { "size", "file size in bytes or None" },
+    { "uid", "user id of the owner or None" },
+    { "gid", "group id of the owner or None" },
+    { "perms", "permissions and file type bits or None" },
+    { "atime", "last access time or None" },
+    { "mtime", "last modification time or None" },
+    { NULL }
+};
+
+static PyStructSequence_Desc sftpdir_entry_desc = {
+    "SftpDirEntry",
+    "Directory entry returned by Sftp.scandir()",
+    sftpdir_entry_fields,
+    7
+};
+
+PyTypeObject PYLIBSSH2_SftpDirEntry_Type;
+/* }}} */
+
+/* {{{ sftpdir_attr
+ *
+ * Boxes an attribute the server sent, None otherwise.
+ */
+static PyObject *
+sftpdir_attr(LIBSSH2_SFTP_ATTRIBUTES *attrs, unsigned long flag,
+             libssh2_uint64_t value)
+{
+    if (!(attrs->flags & flag)) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    /* small values share the cached ints */
+    if (value <= (libssh2_uint64_t)PY_SSIZE_T_MAX) {
+        return PyInt_FromSsize_t((Py_ssize_t)value);
+    }
+
+    return PyLong_FromUnsignedLongLong(value);
+}
+/* }}} */
+
+/* {{{ sftpdir_entry
+ */
+static PyObject *
+sftpdir_entry(const char *name, size_t len, LIBSSH2_SFTP_ATTRIBUTES *attrs)
+{
+    PyObject *entry;
+
+    entry = PyStructSequence_New(&PYLIBSSH2_SftpDirEntry_Type);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    PyStructSequence_SET_ITEM(entry, 0, PyString_FromStringAndSize(name, len));
+    PyStructSequence_SET_ITEM(entry, 1,
+        sftpdir_attr(attrs, LIBSSH2_SFTP_ATTR_SIZE, attrs->filesize));
+    PyStructSequence_SET_ITEM(entry, 2,
+        sftpdir_attr(attrs, LIBSSH2_SFTP_ATTR_UIDGID, attrs->uid));
+    PyStructSequence_SET_ITEM(entry, 3,
+        sftpdir_attr(attrs, LIBSSH2_SFTP_ATTR_UIDGID, attrs->gid));
+    PyStructSequence_SET_ITEM(entry, 4,
+        sftpdir_attr(attrs, LIBSSH2_SFTP_ATTR_PERMISSIONS, attrs->permissions));
+    PyStructSequence_SET_ITEM(entry, 5,
+        sftpdir_attr(attrs, LIBSSH2_SFTP_ATTR_ACMODTIME, attrs->atime));
+    PyStructSequence_SET_ITEM(entry, 6,
+        sftpdir_attr(attrs, LIBSSH2_SFTP_ATTR_ACMODTIME, attrs->mtime));
+
+    if (PyErr_Occurred()) {
+        Py_DECREF(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+/* }}} */
+
+/* {{{ sftpdir_close
+ *
+ * Closes the directory handle. Called with the session lock held and
+ * without the GIL. Once the sftp channel is shut down, the handle is only
+ * dropped.
+ */
+static void
+sftpdir_close(PYLIBSSH2_SFTPDIR *self)
+{
+    PYLIBSSH2_SESSION *session = self->sftp->session;
+
+    /* after a shutdown, the sftp channel of the handle is freed */
+    while (self->sftp->sftp != NULL &&
+           libssh2_sftp_close_handle(self->handle) == LIBSSH2_ERROR_EAGAIN &&
+           wait_session(session->session, session->fd) == 0)
+        ;
+    self->handle = NULL;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_SftpDir_methods[]
+ */
+static PyMethodDef PYLIBSSH2_SftpDir_methods[] = {
+    { NULL, NULL }
+};
+/* }}} */
+
+/* {{{ PYLIBSSH2_SftpDir_New
+ */
+PYLIBSSH2_SFTPDIR *
+PYLIBSSH2_SftpDir_New(LIBSSH2_SFTP_HANDLE *handle, PYLIBSSH2_SFTP *sftp)
+{
+    PYLIBSSH2_SFTPDIR *self;
+
+    self = PyObject_New(PYLIBSSH2_SFTPDIR, &PYLIBSSH2_SftpDir_Type);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->buffer = PyMem_Malloc(SFTPDIR_NAME_MAX);
+    if (self->buffer == NULL) {
+        PyObject_Del(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    Py_INCREF(sftp);
+    self->sftp = sftp;
+    self->handle = handle;
+    self->busy = 0;
+
+    return self;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_SftpDir_dealloc
+ */
+static void
+PYLIBSSH2_SftpDir_dealloc(PYLIBSSH2_SFTPDIR *self)
+{
+    if (self->handle != NULL) {
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(self->sftp->session)
+        sftpdir_close(self);
+        PYLIBSSH2_END_ALLOW_THREADS(self->sftp->session)
+    }
+    PyMem_Free(self->buffer);
+    Py_XDECREF(self->sftp);
+
+    PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_SftpDir_iternext
+ *
+ * Reads the next entry, skipping "." and "..". libssh2 fetches the names
+ * a packet at a time, so most calls do not touch the network. The handle
+ * is closed as soon as the listing ends.
+ */
+static PyObject *
+PYLIBSSH2_SftpDir_iternext(PYLIBSSH2_SFTPDIR *self)
+{
+    int rc;
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    PYLIBSSH2_SESSION *session = self->sftp->session;
+
+    if (self->busy) {
+        PyErr_SetString(PYLIBSSH2_Error,
+                        "Sftp directory is being read by another thread.");
+        return NULL;
+    }
+
+    while (self->handle != NULL) {
+        self->busy = 1;
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(session)
+        /* the shutdown may have happened while waiting for the lock */
+        if (self->sftp->sftp == NULL) {
+            sftpdir_close(self);
+            rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+        }
+        else {
+            do {
+                rc = libssh2_sftp_readdir(self->handle, self->buffer,
+                                          SFTPDIR_NAME_MAX, &attrs);
+            } while (rc == LIBSSH2_ERROR_EAGAIN &&
+                     (rc = wait_session(session->session, session->fd)) == 0);
+            if (rc <= 0) {
+                sftpdir_close(self);
+            }
+        }
+        PYLIBSSH2_END_ALLOW_THREADS(session)
+        self->busy = 0;
+
+        if (sftp_shut_down(self->sftp)) {
+            return NULL;
+        }
+
+        if (rc == LIBSSH2_ERROR_TIMEOUT) {
+            return session_timeout_error();
+        }
+        if (rc < 0) {
+            /* CLEAN: PYLIBSSH2_SFTPHANDLE_CANT_READDIR_MSG */
+            PyErr_Format(PYLIBSSH2_Error, "Unable to readdir (error %d).", rc);
+            return NULL;
+        }
+        if (rc == 0) {
+            break;
+        }
+
+        if ((rc == 1 && self->buffer[0] == '.') ||
+            (rc == 2 && memcmp(self->buffer, "..", 2) == 0)) {
+            continue;
+        }
+
+        return sftpdir_entry(self->buffer, rc, &attrs);
+    }
+
+    return NULL;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_SftpDir_getattr
+ */
+static PyObject *
+PYLIBSSH2_SftpDir_getattr(PYLIBSSH2_SFTPDIR *self, char *name)
+{
+    return Py_FindMethod(PYLIBSSH2_SftpDir_methods, (PyObject *)self, name);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_SftpDir_Type
+ *
+ * see /usr/include/python2.5/object.h line 261
+ */
+PyTypeObject PYLIBSSH2_SftpDir_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "SftpDir",                                  /* tp_name */
+    sizeof(PYLIBSSH2_SFTPDIR),                  /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PYLIBSSH2_SftpDir_dealloc,      /* tp_dealloc */
+    0,                                          /* tp_print */
+    (getattrfunc)PYLIBSSH2_SftpDir_getattr,     /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    "Lazy sftp directory iterator objects",     /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    PyObject_SelfIter,                          /* tp_iter */
+    (iternextfunc)PYLIBSSH2_SftpDir_iternext,   /* tp_iternext */
+};
+/* }}} */
+
+/* {{{ init_libssh2_SftpDir
+ */
+int
+init_libssh2_SftpDir(PyObject *dict)
+{
+    PYLIBSSH2_SftpDir_Type.ob_type = &PyType_Type;
+    Py_XINCREF(&PYLIBSSH2_SftpDir_Type);
+    PyDict_SetItemString(dict, "SftpDirType", (PyObject *)&PYLIBSSH2_SftpDir_Type);
+
+    PyStructSequence_InitType(&PYLIBSSH2_SftpDirEntry_Type, &sftpdir_entry_desc);
+    Py_INCREF(&PYLIBSSH2_SftpDirEntry_Type);
+    PyDict_SetItemString(dict, "SftpDirEntry", (PyObject *)&PYLIBSSH2_SftpDirEntry_Type);
+
+    return 1;
+}
+/* }}} */
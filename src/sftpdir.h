@@ -0,0 +1,56 @@
+/*-
+ * pylibssh2 - python bindings for libssh2 library
+ *
+ * Copyright (C) 2010 Wallix Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+#ifndef _PYLIBSSH2_SFTPDIR_H_
+#define _PYLIBSSH2_SFTPDIR_H_
+
+#include <Python.h>
+#include <structseq.h>
+#include <libssh2.h>
+#include <libssh2_sftp.h>
+
+#include "sftp.h"
+
+/*
+ * libssh2_sftp_readdir() drops an entry whose name does not fit in the
+ * buffer, so it is sized for the largest SFTP packet libssh2 accepts.
+ */
+#define SFTPDIR_NAME_MAX (256 * 1024)
+
+extern int init_libssh2_SftpDir(PyObject *);
+
+extern PyTypeObject PYLIBSSH2_SftpDir_Type;
+extern PyTypeObject PYLIBSSH2_SftpDirEntry_Type;
+
+#define PYLIBSSH2_SftpDir_Check(v) ((v)->ob_type == &PYLIBSSH2_SftpDir_Type)
+
+typedef struct {
+    PyObject_HEAD
+    /* parent sftp channel, kept alive as long as the iterator */
+    PYLIBSSH2_SFTP      *sftp;
+    /* directory handle, NULL once the listing is exhausted */
+    LIBSSH2_SFTP_HANDLE *handle;
+    char                *buffer;
+    /* a readdir fills the buffer with the GIL released */
+    int                 busy;
+} PYLIBSSH2_SFTPDIR;
+
+PYLIBSSH2_SFTPDIR * PYLIBSSH2_SftpDir_New(LIBSSH2_SFTP_HANDLE *, PYLIBSSH2_SFTP *);
+
+#endif /* _PYLIBSSH2_SFTPDIR_H_ */
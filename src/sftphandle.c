@@ -19,10 +19,842 @@
  * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 #include <Python.h>
+#include <string.h>
 #define PYLIBSSH2_MODULE
 #include "pylibssh2.h"
 
-/*
+/* {{{ sftphandle_error
+ */
+static PyObject *
+sftphandle_error(PYLIBSSH2_SFTPHANDLE *self, int rc, const char *action)
+{
+    /* the sftp channel was shut down while the call waited for the lock */
+    if (sftp_shut_down(self->sftp)) {
+        return NULL;
+    }
+
+    if (rc == LIBSSH2_ERROR_TIMEOUT) {
+        return session_timeout_error();
+    }
+
+    /* CLEAN: PYLIBSSH2_SFTPHANDLE_CANT_ACTION_MSG */
+    PyErr_Format(PYLIBSSH2_Error, "Unable to %s sftp handle (error %d).",
+                 action, rc);
+    return NULL;
+}
+/* }}} */
+
+/* {{{ sftphandle_busy
+ *
+ * Returns 1 with a Python exception set if another thread is using the
+ * handle, as libssh2 fills its buffer with the GIL released.
+ */
+static int
+sftphandle_busy(PYLIBSSH2_SFTPHANDLE *self)
+{
+    if (self->busy) {
+        PyErr_SetString(PYLIBSSH2_Error,
+                        "Sftp handle is being used by another thread.");
+        return 1;
+    }
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ sftphandle_closed
+ *
+ * Returns 1 with a Python exception set if the handle is closed, used by
+ * another thread or its sftp channel is shut down.
+ */
+int
+sftphandle_closed(PYLIBSSH2_SFTPHANDLE *self)
+{
+    if (self->sftphandle == NULL) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed file");
+        return 1;
+    }
+
+    if (sftphandle_busy(self)) {
+        return 1;
+    }
+
+    return sftp_shut_down(self->sftp);
+}
+/* }}} */
+
+/* {{{ sftphandle_reserve
+ *
+ * Grows the buffer to hold at least size bytes.
+ */
+static int
+sftphandle_reserve(PYLIBSSH2_SFTPHANDLE *self, size_t size)
+{
+    char *grown;
+
+    if (self->size >= size) {
+        return 0;
+    }
+
+    grown = PyMem_Realloc(self->buffer, size);
+    if (grown == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->buffer = grown;
+    self->size = size;
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ sftphandle_io_read
+ *
+ * Reads from the remote file, polling the session socket on
+ * LIBSSH2_ERROR_EAGAIN. Returns the number of bytes read, 0 at end of file
+ * or a negative libssh2 error code.
+ */
+static ssize_t
+sftphandle_io_read(PYLIBSSH2_SFTPHANDLE *self, char *buffer, size_t len)
+{
+    ssize_t rc;
+    PYLIBSSH2_SESSION *session = self->sftp->session;
+
+    self->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(session)
+    if (self->sftp->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        do {
+            rc = libssh2_sftp_read(self->sftphandle, buffer, len);
+        } while (rc == LIBSSH2_ERROR_EAGAIN &&
+                 (rc = wait_session(session->session, session->fd)) == 0);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(session)
+    self->busy = 0;
+
+    return rc;
+}
+/* }}} */
+
+/* {{{ sftphandle_io_write
+ *
+ * Writes the whole buffer to the remote file. Returns 0 or a negative
+ * libssh2 error code.
+ */
+static int
+sftphandle_io_write(PYLIBSSH2_SFTPHANDLE *self, const char *buffer,
+                    size_t len)
+{
+    int rc = 0;
+
+    self->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->sftp->session)
+    if (self->sftp->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        sftp_write_all(self->sftp, self->sftphandle, buffer, len, &rc);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->sftp->session)
+    self->busy = 0;
+
+    return rc;
+}
+/* }}} */
+
+/* {{{ sftphandle_io_seek
+ *
+ * Moves the remote position, dropping the read-ahead data and the read
+ * requests libssh2 has in flight.
+ */
+static void
+sftphandle_io_seek(PYLIBSSH2_SFTPHANDLE *self, libssh2_uint64_t offset)
+{
+    self->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->sftp->session)
+    /* once shut down, the next call on the handle reports it */
+    if (self->sftp->sftp != NULL) {
+        libssh2_sftp_seek64(self->sftphandle, offset);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(self->sftp->session)
+    self->busy = 0;
+
+    self->pos = self->len = 0;
+    self->window = SFTPHANDLE_MIN_WINDOW;
+    self->state = SFTPHANDLE_IDLE;
+}
+/* }}} */
+
+/* {{{ sftphandle_flush
+ *
+ * Sends the pending writes. Returns 0 or -1 with a Python exception set.
+ */
+static int
+sftphandle_flush(PYLIBSSH2_SFTPHANDLE *self)
+{
+    int rc;
+    size_t len = self->len;
+
+    if (self->state != SFTPHANDLE_WRITING || len == 0) {
+        return 0;
+    }
+
+    /* pending bytes are dropped on failure, the caller gets the error */
+    self->len = 0;
+    rc = sftphandle_io_write(self, self->buffer, len);
+    if (rc < 0) {
+        sftphandle_error(self, rc, "write");
+        return -1;
+    }
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ sftphandle_sync
+ *
+ * Sends the pending writes and drops the read-ahead data, leaving the
+ * remote position at the caller's offset, before a raw libssh2 call on
+ * the handle. Returns 0 or -1 with a Python exception set.
+ */
+int
+sftphandle_sync(PYLIBSSH2_SFTPHANDLE *self)
+{
+    if (self->state == SFTPHANDLE_WRITING && sftphandle_flush(self) < 0) {
+        return -1;
+    }
+    if (self->state == SFTPHANDLE_READING) {
+        sftphandle_io_seek(self, self->offset);
+    }
+    self->state = SFTPHANDLE_IDLE;
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ sftphandle_begin_read
+ *
+ * Switches the handle to reading, sending the pending writes first.
+ */
+static int
+sftphandle_begin_read(PYLIBSSH2_SFTPHANDLE *self)
+{
+    if (self->state == SFTPHANDLE_WRITING) {
+        if (sftphandle_flush(self) < 0) {
+            return -1;
+        }
+        self->state = SFTPHANDLE_IDLE;
+    }
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ sftphandle_fill
+ *
+ * Appends the next read-ahead window to the buffer, moving unread bytes
+ * to its head. Each refill of a sequential reader doubles the window, up
+ * to SFTPHANDLE_MAX_WINDOW. Returns the number of bytes read, 0 at end of
+ * file or a negative value with a Python exception set.
+ */
+static ssize_t
+sftphandle_fill(PYLIBSSH2_SFTPHANDLE *self)
+{
+    ssize_t rc;
+
+    if (self->pos > 0) {
+        memmove(self->buffer, self->buffer + self->pos, self->len - self->pos);
+        self->len -= self->pos;
+        self->pos = 0;
+    }
+
+    if (self->state == SFTPHANDLE_READING &&
+        self->window < SFTPHANDLE_MAX_WINDOW) {
+        self->window *= 2;
+    }
+    self->state = SFTPHANDLE_READING;
+
+    if (sftphandle_reserve(self, self->len + self->window) < 0) {
+        return -1;
+    }
+
+    rc = sftphandle_io_read(self, self->buffer + self->len, self->window);
+    if (rc > 0) {
+        self->len += rc;
+    }
+    else if (rc < 0) {
+        sftphandle_error(self, rc, "read");
+    }
+
+    return rc;
+}
+/* }}} */
+
+/* {{{ sftphandle_take
+ *
+ * Consumes len buffered bytes into dst.
+ */
+static void
+sftphandle_take(PYLIBSSH2_SFTPHANDLE *self, char *dst, size_t len)
+{
+    memcpy(dst, self->buffer + self->pos, len);
+    self->pos += len;
+    self->offset += len;
+    if (self->pos == self->len) {
+        self->pos = self->len = 0;
+    }
+}
+/* }}} */
+
+/* {{{ sftphandle_readinto
+ *
+ * Fills dst up to len bytes or end of file. Requests larger than the
+ * read-ahead window bypass the buffer. Returns the number of bytes stored
+ * or -1 with a Python exception set.
+ */
+static Py_ssize_t
+sftphandle_readinto(PYLIBSSH2_SFTPHANDLE *self, char *dst, size_t len)
+{
+    ssize_t rc;
+    size_t done = 0;
+    size_t avail;
+
+    if (sftphandle_begin_read(self) < 0) {
+        return -1;
+    }
+
+    while (done < len) {
+        avail = self->len - self->pos;
+        if (avail > 0) {
+            if (avail > len - done) {
+                avail = len - done;
+            }
+            sftphandle_take(self, dst + done, avail);
+            done += avail;
+            continue;
+        }
+
+        if (len - done >= self->window) {
+            self->state = SFTPHANDLE_READING;
+            rc = sftphandle_io_read(self, dst + done, len - done);
+            if (rc < 0) {
+                sftphandle_error(self, rc, "read");
+                return -1;
+            }
+            done += rc;
+            self->offset += rc;
+        }
+        else {
+            rc = sftphandle_fill(self);
+            if (rc < 0) {
+                return -1;
+            }
+        }
+        if (rc == 0) {
+            break;
+        }
+    }
+
+    return done;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_read
+ */
+static char PYLIBSSH2_Sftphandle_read_doc[] = "\n\
+read([size]) -> str\n\
+\n\
+Reads size bytes from the file, or up to end of file.\n\
+\n\
+@param  size: number of bytes to read, -1 to read up to end of file\n\
+@type   size: int\n\
+\n\
+@return bytes read, empty at end of file\n\
+@rtype  str";
+
+static PyObject *
+PYLIBSSH2_Sftphandle_read(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    ssize_t rc;
+    Py_ssize_t size = -1;
+    Py_ssize_t done;
+    PyObject *data;
+
+    if (!PyArg_ParseTuple(args, "|n:read", &size)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(self) || sftphandle_begin_read(self) < 0) {
+        return NULL;
+    }
+
+    if (size < 0) {
+        do {
+            rc = sftphandle_fill(self);
+            if (rc < 0) {
+                return NULL;
+            }
+        } while (rc > 0);
+
+        data = PyString_FromStringAndSize(NULL, self->len - self->pos);
+        if (data == NULL) {
+            return NULL;
+        }
+        sftphandle_take(self, PyString_AS_STRING(data), self->len - self->pos);
+        return data;
+    }
+
+    data = PyString_FromStringAndSize(NULL, size);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    done = sftphandle_readinto(self, PyString_AS_STRING(data), size);
+    if (done < 0) {
+        Py_DECREF(data);
+        return NULL;
+    }
+    if (done != size && _PyString_Resize(&data, done) < 0) {
+        return NULL;
+    }
+
+    return data;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_readinto
+ */
+static char PYLIBSSH2_Sftphandle_readinto_doc[] = "\n\
+readinto(buffer) -> int\n\
+\n\
+Reads bytes from the file directly into a writable buffer, until it is\n\
+full or end of file.\n\
+\n\
+@param  buffer: preallocated storage (bytearray, memoryview, mmap...)\n\
+@type   buffer: writable buffer\n\
+\n\
+@return number of bytes stored in buffer, 0 at end of file\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Sftphandle_readinto(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    Py_ssize_t done;
+    /* caller-owned storage, filled in place */
+    Py_buffer buffer;
+
+    if (!PyArg_ParseTuple(args, "w*:readinto", &buffer)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(self)) {
+        PyBuffer_Release(&buffer);
+        return NULL;
+    }
+
+    done = sftphandle_readinto(self, buffer.buf, buffer.len);
+    PyBuffer_Release(&buffer);
+    if (done < 0) {
+        return NULL;
+    }
+
+    return Py_BuildValue("n", done);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_readline
+ */
+static char PYLIBSSH2_Sftphandle_readline_doc[] = "\n\
+readline([limit]) -> str\n\
+\n\
+Reads one line, including its trailing newline.\n\
+\n\
+@param  limit: maximum number of bytes to return, -1 for no limit\n\
+@type   limit: int\n\
+\n\
+@return the line, the remaining bytes or an empty string at end of file\n\
+@rtype  str";
+
+static PyObject *
+sftphandle_readline(PYLIBSSH2_SFTPHANDLE *self, Py_ssize_t limit)
+{
+    ssize_t rc;
+    /* buffered bytes already searched without match */
+    size_t scanned = 0;
+    size_t avail, window;
+    const char *found;
+    PyObject *line;
+
+    if (sftphandle_closed(self) || sftphandle_begin_read(self) < 0) {
+        return NULL;
+    }
+
+    while (1) {
+        avail = self->len - self->pos;
+        window = avail;
+        if (limit >= 0 && window > (size_t)limit) {
+            window = limit;
+        }
+
+        found = memchr(self->buffer + self->pos + scanned, '\n',
+                       window - scanned);
+        if (found != NULL) {
+            window = found + 1 - (self->buffer + self->pos);
+            break;
+        }
+        if ((limit >= 0 && avail >= (size_t)limit)) {
+            break;
+        }
+        scanned = window;
+
+        rc = sftphandle_fill(self);
+        if (rc < 0) {
+            return NULL;
+        }
+        if (rc == 0) {
+            window = self->len - self->pos;
+            break;
+        }
+    }
+
+    line = PyString_FromStringAndSize(NULL, window);
+    if (line == NULL) {
+        return NULL;
+    }
+    sftphandle_take(self, PyString_AS_STRING(line), window);
+
+    return line;
+}
+
+static PyObject *
+PYLIBSSH2_Sftphandle_readline(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    Py_ssize_t limit = -1;
+
+    if (!PyArg_ParseTuple(args, "|n:readline", &limit)) {
+        return NULL;
+    }
+
+    return sftphandle_readline(self, limit);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_write
+ */
+static char PYLIBSSH2_Sftphandle_write_doc[] = "\n\
+write(data) -> int\n\
+\n\
+Writes data to the file. Small writes are coalesced and sent once they\n\
+add up to a large SFTP write, on flush(), seek(), fstat() or close().\n\
+\n\
+@param  data: bytes to write\n\
+@type   data: str or buffer\n\
+\n\
+@return number of bytes written\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Sftphandle_write(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    int rc;
+    Py_buffer data;
+
+    if (!PyArg_ParseTuple(args, "s*:write", &data)) {
+        return NULL;
+    }
+
+    if (sftphandle_closed(self)) {
+        goto error;
+    }
+
+    if (self->state == SFTPHANDLE_READING) {
+        /* the remote position is ahead of the caller by the read-ahead */
+        sftphandle_io_seek(self, self->offset);
+    }
+    self->state = SFTPHANDLE_WRITING;
+
+    if (self->len + data.len > SFTPHANDLE_WRITE_SIZE &&
+        sftphandle_flush(self) < 0) {
+        goto error;
+    }
+
+    if (data.len >= SFTPHANDLE_WRITE_SIZE) {
+        rc = sftphandle_io_write(self, data.buf, data.len);
+        if (rc < 0) {
+            sftphandle_error(self, rc, "write");
+            goto error;
+        }
+    }
+    else {
+        if (sftphandle_reserve(self, SFTPHANDLE_WRITE_SIZE) < 0) {
+            goto error;
+        }
+        memcpy(self->buffer + self->len, data.buf, data.len);
+        self->len += data.len;
+    }
+    self->offset += data.len;
+
+    PyBuffer_Release(&data);
+    return Py_BuildValue("n", data.len);
+
+error:
+    PyBuffer_Release(&data);
+    return NULL;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_flush
+ */
+static char PYLIBSSH2_Sftphandle_flush_doc[] = "\n\
+flush() -> None\n\
+\n\
+Sends the pending writes.\n\
+\n\
+@return None\n\
+@rtype  None";
+
+static PyObject *
+PYLIBSSH2_Sftphandle_flush(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    if (sftphandle_closed(self) || sftphandle_flush(self) < 0) {
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_fstat
+ */
+static char PYLIBSSH2_Sftphandle_fstat_doc[] = "\n\
+fstat() -> list\n\
+\n\
+Returns the attributes of the file, once the pending writes are sent.\n\
+\n\
+@return [size, uid, gid, permissions, atime, mtime]\n\
+@rtype  list";
+
+static int
+sftphandle_fstat(PYLIBSSH2_SFTPHANDLE *self, LIBSSH2_SFTP_ATTRIBUTES *attr)
+{
+    int rc;
+    PYLIBSSH2_SESSION *session = self->sftp->session;
+
+    if (sftphandle_flush(self) < 0) {
+        return -1;
+    }
+
+    self->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(session)
+    if (self->sftp->sftp == NULL) {
+        rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+    }
+    else {
+        do {
+            rc = libssh2_sftp_fstat_ex(self->sftphandle, attr, 0);
+        } while (rc == LIBSSH2_ERROR_EAGAIN &&
+                 (rc = wait_session(session->session, session->fd)) == 0);
+    }
+    PYLIBSSH2_END_ALLOW_THREADS(session)
+    self->busy = 0;
+
+    if (rc < 0) {
+        sftphandle_error(self, rc, "stat");
+        return -1;
+    }
+
+    return 0;
+}
+
+static PyObject *
+PYLIBSSH2_Sftphandle_fstat(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    LIBSSH2_SFTP_ATTRIBUTES attr;
+
+    if (sftphandle_closed(self) || sftphandle_fstat(self, &attr) < 0) {
+        return NULL;
+    }
+
+    return get_attrs(&attr);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_seek
+ */
+static char PYLIBSSH2_Sftphandle_seek_doc[] = "\n\
+seek(offset, [whence]) -> int\n\
+\n\
+Moves the file position. Seeking within the read-ahead data does not\n\
+touch the network.\n\
+\n\
+@param  offset: new position, relative to whence\n\
+@type   offset: int\n\
+@param  whence: 0 for the start of file, 1 for the current position, 2\n\
+        for the end of file\n\
+@type   whence: int\n\
+\n\
+@return the new position\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Sftphandle_seek(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    PY_LONG_LONG offset;
+    PY_LONG_LONG target;
+    PY_LONG_LONG base = 0;
+    int whence = 0;
+    LIBSSH2_SFTP_ATTRIBUTES attr;
+
+    if (!PyArg_ParseTuple(args, "L|i:seek", &offset, &whence)) {
+        return NULL;
+    }
+
+    if (whence < 0 || whence > 2) {
+        PyErr_SetString(PyExc_ValueError, "invalid whence");
+        return NULL;
+    }
+
+    if (sftphandle_closed(self) || sftphandle_flush(self) < 0) {
+        return NULL;
+    }
+
+    if (whence == 1) {
+        base = self->offset;
+    }
+    else if (whence == 2) {
+        if (sftphandle_fstat(self, &attr) < 0) {
+            return NULL;
+        }
+        base = attr.filesize;
+    }
+
+    target = base + offset;
+    if (target < 0) {
+        PyErr_SetString(PyExc_ValueError, "negative seek position");
+        return NULL;
+    }
+
+    if (self->state == SFTPHANDLE_READING &&
+        target >= (PY_LONG_LONG)(self->offset - self->pos) &&
+        target <= (PY_LONG_LONG)(self->offset + self->len - self->pos)) {
+        self->pos += target - (PY_LONG_LONG)self->offset;
+        self->offset = target;
+    }
+    else {
+        sftphandle_io_seek(self, target);
+        self->offset = target;
+    }
+
+    return PyLong_FromUnsignedLongLong(self->offset);
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_tell
+ */
+static char PYLIBSSH2_Sftphandle_tell_doc[] = "\n\
+tell() -> int\n\
+\n\
+Returns the current file position.\n\
+\n\
+@return the current position\n\
+@rtype  int";
+
+static PyObject *
+PYLIBSSH2_Sftphandle_tell(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    if (sftphandle_closed(self)) {
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLongLong(self->offset);
+}
+/* }}} */
+
+/* {{{ sftphandle_close
+ *
+ * Sends the pending writes and closes the remote handle. Called with the
+ * session lock held and without the GIL. Once the sftp channel is shut
+ * down, the handle is only dropped and pending writes are lost.
+ */
+int
+sftphandle_close(PYLIBSSH2_SFTPHANDLE *self)
+{
+    int rc = 0;
+    int rc_close;
+    PYLIBSSH2_SESSION *session = self->sftp->session;
+
+    if (self->sftphandle == NULL) {
+        return 0;
+    }
+
+    if (self->sftp->sftp == NULL) {
+        /* libssh2 freed the sftp channel the handle points to */
+        if (self->state == SFTPHANDLE_WRITING && self->len > 0) {
+            rc = LIBSSH2_ERROR_CHANNEL_CLOSED;
+        }
+        self->pos = self->len = 0;
+        self->state = SFTPHANDLE_IDLE;
+        self->sftphandle = NULL;
+        return rc;
+    }
+
+    if (self->state == SFTPHANDLE_WRITING && self->len > 0) {
+        sftp_write_all(self->sftp, self->sftphandle, self->buffer, self->len,
+                       &rc);
+    }
+    self->pos = self->len = 0;
+    self->state = SFTPHANDLE_IDLE;
+
+    while ((rc_close = libssh2_sftp_close_handle(self->sftphandle)) ==
+           LIBSSH2_ERROR_EAGAIN &&
+           (rc_close = wait_session(session->session, session->fd)) == 0)
+        ;
+    self->sftphandle = NULL;
+
+    return rc ? rc : rc_close;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_close
+ */
+static char PYLIBSSH2_Sftphandle_close_doc[] = "\n\
+close() -> None\n\
+\n\
+Sends the pending writes and closes the file. Closing a closed file has\n\
+no effect.\n\
+\n\
+@return None\n\
+@rtype  None";
+
+static PyObject *
+PYLIBSSH2_Sftphandle_close(PYLIBSSH2_SFTPHANDLE *self, PyObject *args)
+{
+    int rc;
+
+    if (sftphandle_busy(self)) {
+        return NULL;
+    }
+
+    self->busy = 1;
+    PYLIBSSH2_BEGIN_ALLOW_THREADS(self->sftp->session)
+    rc = sftphandle_close(self);
+    PYLIBSSH2_END_ALLOW_THREADS(self->sftp->session)
+    self->busy = 0;
+
+    if (rc < 0) {
+        return sftphandle_error(self, rc, "close");
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_methods[]
+ *
  * ADD_METHOD(name) expands to a correct PyMethodDef declaration
  *   {  'name', (PyCFunction)PYLIBSSH2_Sftphandle_name, METH_VARARGS }
  * for convenience
@@ -32,11 +864,25 @@
 
 static PyMethodDef PYLIBSSH2_Sftphandle_methods[] =
 {
+    ADD_METHOD(read),
+    ADD_METHOD(readinto),
+    ADD_METHOD(readline),
+    ADD_METHOD(write),
+    ADD_METHOD(flush),
+    ADD_METHOD(fstat),
+    ADD_METHOD(seek),
+    ADD_METHOD(tell),
+    ADD_METHOD(close),
     { NULL, NULL }
 };
+#undef ADD_METHOD
+/* }}} */
 
+/* {{{ PYLIBSSH2_Sftphandle_New
+ */
 PYLIBSSH2_SFTPHANDLE *
-PYLIBSSH2_Sftphandle_New(LIBSSH2_SFTP_HANDLE *sftphandle, int dealloc)
+PYLIBSSH2_Sftphandle_New(LIBSSH2_SFTP_HANDLE *sftphandle, PYLIBSSH2_SFTP *sftp,
+                         int dealloc)
 {
     PYLIBSSH2_SFTPHANDLE *self;
 
@@ -45,23 +891,69 @@ PYLIBSSH2_Sftphandle_New(LIBSSH2_SFTP_HANDLE *sftphandle, int dealloc)
         return NULL;
     }
 
+    Py_INCREF(sftp);
     self->sftphandle = sftphandle;
+    self->sftp = sftp;
     self->dealloc = dealloc;
+    self->buffer = NULL;
+    self->size = 0;
+    self->pos = 0;
+    self->len = 0;
+    self->window = SFTPHANDLE_MIN_WINDOW;
+    self->state = SFTPHANDLE_IDLE;
+    self->offset = 0;
+    self->busy = 0;
 
     return self;
 }
+/* }}} */
 
+/* {{{ PYLIBSSH2_Sftphandle_dealloc
+ */
 static void
 PYLIBSSH2_Sftphandle_dealloc(PYLIBSSH2_SFTPHANDLE *self)
 {
+    if (self->sftphandle != NULL && self->dealloc) {
+        PYLIBSSH2_BEGIN_ALLOW_THREADS(self->sftp->session)
+        sftphandle_close(self);
+        PYLIBSSH2_END_ALLOW_THREADS(self->sftp->session)
+    }
+    PyMem_Free(self->buffer);
+    Py_XDECREF(self->sftp);
+
     PyObject_Del(self);
 }
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_iternext
+ */
+static PyObject *
+PYLIBSSH2_Sftphandle_iternext(PYLIBSSH2_SFTPHANDLE *self)
+{
+    PyObject *line;
 
+    line = sftphandle_readline(self, -1);
+    if (line == NULL) {
+        return NULL;
+    }
+
+    if (PyString_GET_SIZE(line) == 0) {
+        Py_DECREF(line);
+        return NULL;
+    }
+
+    return line;
+}
+/* }}} */
+
+/* {{{ PYLIBSSH2_Sftphandle_getattr
+ */
 static PyObject *
 PYLIBSSH2_Sftphandle_getattr(PYLIBSSH2_SFTPHANDLE *self, char *name)
 {
     return Py_FindMethod(PYLIBSSH2_Sftphandle_methods, (PyObject *)self, name);
 }
+/* }}} */
 
 /*
  * see /usr/include/python2.5/object.c line 261
@@ -89,6 +981,12 @@ PyTypeObject PYLIBSSH2_Sftphandle_Type = {
     0,                                     /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT,                    /* tp_flags */
     "Sftphandle objects",                  /* tp_doc */
+    0,                                     /* tp_traverse */
+    0,                                     /* tp_clear */
+    0,                                     /* tp_richcompare */
+    0,                                     /* tp_weaklistoffset */
+    PyObject_SelfIter,                     /* tp_iter */
+    (iternextfunc)PYLIBSSH2_Sftphandle_iternext, /* tp_iternext */
 };
 
 int
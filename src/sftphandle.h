@@ -24,18 +24,49 @@
 #include <Python.h>
 #include <libssh2.h>
 
+#include "sftp.h"
+
 extern int init_libssh2_Sftphandle(PyObject *);
 
 extern PyTypeObject PYLIBSSH2_Sftphandle_Type;
 
 #define PYLIBSSH2_Sftphandle_Check(v) ((v)->ob_type == &PYLIBSSH2_Sftphandle_Type)
 
+/* first read-ahead window, doubled on each sequential refill */
+#define SFTPHANDLE_MIN_WINDOW   32768
+#define SFTPHANDLE_MAX_WINDOW   (1024 * 1024)
+/* pending writes are sent once they reach this size */
+#define SFTPHANDLE_WRITE_SIZE   (256 * 1024)
+
+#define SFTPHANDLE_IDLE         0
+#define SFTPHANDLE_READING      1
+#define SFTPHANDLE_WRITING      2
+
 typedef struct {
     PyObject_HEAD
+    /* NULL once closed */
     LIBSSH2_SFTP_HANDLE *sftphandle;
+    /* parent sftp channel, kept alive as long as the handle */
+    PYLIBSSH2_SFTP *sftp;
     int dealloc;
+    /* read-ahead data in [pos, len) or pending writes in [0, len) */
+    char *buffer;
+    size_t size;
+    size_t pos;
+    size_t len;
+    size_t window;
+    int state;
+    /* position seen by the caller */
+    libssh2_uint64_t offset;
+    /* a call is using the handle with the GIL released */
+    int busy;
 } PYLIBSSH2_SFTPHANDLE;
 
-PYLIBSSH2_SFTPHANDLE * PYLIBSSH2_Sftphandle_New(LIBSSH2_SFTP_HANDLE *, int);
+PYLIBSSH2_SFTPHANDLE * PYLIBSSH2_Sftphandle_New(LIBSSH2_SFTP_HANDLE *,
+                                                PYLIBSSH2_SFTP *, int);
+
+int sftphandle_closed(PYLIBSSH2_SFTPHANDLE *);
+int sftphandle_sync(PYLIBSSH2_SFTPHANDLE *);
+int sftphandle_close(PYLIBSSH2_SFTPHANDLE *);
 
 #endif /* _PYLIBSSH2_SFTPHANDLE_H_ */
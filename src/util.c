@@ -18,6 +18,11 @@
  * along with this library; if not, write to the Free Software Foundation, Inc.,
  * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "util.h"
 
 /* {{{ get_flags
@@ -47,3 +52,86 @@ get_flags(char *mode) {
     return f;
 }
 /* }}} */
+
+/* {{{ wait_socket
+ *
+ * Returns a positive value when the socket is ready (or libssh2 is not
+ * blocked at all), 0 on timeout and a negative value on poll() failure.
+ */
+int
+wait_socket(LIBSSH2_SESSION *session, int fd, int timeout)
+{
+    int rc;
+    int dir;
+    struct pollfd pfd;
+
+    dir = libssh2_session_block_directions(session);
+    if (dir == 0) {
+        return 1;
+    }
+
+    pfd.fd = fd;
+    pfd.events = 0;
+    pfd.revents = 0;
+    if (dir & LIBSSH2_SESSION_BLOCK_INBOUND) {
+        pfd.events |= POLLIN;
+    }
+    if (dir & LIBSSH2_SESSION_BLOCK_OUTBOUND) {
+        pfd.events |= POLLOUT;
+    }
+
+    do {
+        rc = poll(&pfd, 1, timeout);
+    } while (rc < 0 && errno == EINTR);
+
+    return rc;
+}
+/* }}} */
+
+/* {{{ wait_session
+ *
+ * A libssh2 session timeout of 0 means no timeout at all.
+ */
+int
+wait_session(LIBSSH2_SESSION *session, int fd)
+{
+    int rc;
+    long timeout;
+
+    timeout = libssh2_session_get_timeout(session);
+    rc = wait_socket(session, fd, timeout > 0 ? (int)timeout : -1);
+    if (rc == 0) {
+        return LIBSSH2_ERROR_TIMEOUT;
+    }
+    if (rc < 0) {
+        return LIBSSH2_ERROR_SOCKET_NONE;
+    }
+
+    return 0;
+}
+/* }}} */
+
+/* {{{ write_all
+ *
+ * Returns 0 once len bytes are written or -1 with errno set on failure.
+ */
+int
+write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+/* }}} */
@@ -29,4 +29,23 @@
  */
 unsigned long get_flags(char *mode);
 
+/*
+ * Wait on the session socket in the directions libssh2 is blocked on.
+ * Must be called without the GIL; timeout in milliseconds, -1 for none.
+ */
+int wait_socket(LIBSSH2_SESSION *session, int fd, int timeout);
+
+/*
+ * Wait on the session socket like wait_socket(), bounded by the libssh2
+ * session timeout (which per call timeouts override). Returns 0 when the
+ * socket is ready, LIBSSH2_ERROR_TIMEOUT or LIBSSH2_ERROR_SOCKET_NONE.
+ * Must be called without the GIL.
+ */
+int wait_session(LIBSSH2_SESSION *session, int fd);
+
+/*
+ * Write the whole buffer on a local file descriptor, retrying on EINTR.
+ */
+int write_all(int fd, const char *buf, size_t len);
+
 #endif /* _PYLIBSSH2_UTIL_H_ */
@@ -0,0 +1,61 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Shared fixtures of the tests which need an authenticated session.
+
+The server is read from the PYLIBSSH2_TEST_HOST, PYLIBSSH2_TEST_PORT,
+PYLIBSSH2_TEST_USER and PYLIBSSH2_TEST_PASSWORD environment variables, the
+tests are skipped when no password is given.
+"""
+
+import getpass
+import os
+import socket
+import unittest
+
+HOST = os.environ.get("PYLIBSSH2_TEST_HOST", "127.0.0.1")
+PORT = int(os.environ.get("PYLIBSSH2_TEST_PORT", "22"))
+USER = os.environ.get("PYLIBSSH2_TEST_USER", getpass.getuser())
+PASSWORD = os.environ.get("PYLIBSSH2_TEST_PASSWORD")
+
+class SessionTestCase(unittest.TestCase):
+    """
+    Test case running against an authenticated session.
+    """
+    def setUp(self):
+        if PASSWORD is None:
+            self.skipTest("PYLIBSSH2_TEST_PASSWORD is not set")
+        import libssh2
+        self.socket = socket.create_connection((HOST, PORT))
+        self.session = libssh2.Session()
+        self.session.startup(self.socket)
+        self.session.userauth_password(USER, PASSWORD)
+
+    def execute(self, command):
+        """
+        Opens a channel running command.
+        """
+        channel = self.session.open_session()
+        channel.execute(command)
+        return channel
+
+    def tearDown(self):
+        self.session.close()
+        self.socket.close()
@@ -0,0 +1,207 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Unit tests for Channel
+"""
+
+import tempfile
+import threading
+import time
+import unittest
+
+import libssh2
+
+from support import SessionTestCase
+
+class ChannelTest(SessionTestCase):
+    def test_readinto(self):
+        channel = self.execute("printf 'hello world'")
+        buffer = bytearray(64)
+        view = memoryview(buffer)
+        received = 0
+        while True:
+            rc = channel.readinto(view[received:])
+            if rc == 0:
+                break
+            received += rc
+        self.assertEqual(str(buffer[:received]), "hello world")
+
+    def test_readinto_stderr(self):
+        channel = self.execute("printf 'err' >&2")
+        buffer = bytearray(16)
+        self.assertEqual(channel.readinto(buffer, 1), 3)
+        self.assertEqual(str(buffer[:3]), "err")
+
+    def test_read_all(self):
+        channel = self.execute("head -c 300000 /dev/zero")
+        self.assertEqual(channel.read_all(), "\0" * 300000)
+
+    def test_read_all_max_bytes(self):
+        channel = self.execute("head -c 100000 /dev/zero; echo err >&2")
+        self.assertEqual(channel.read_all(1000), "\0" * 1000)
+        self.assertEqual(channel.read_all(stream_id=1), "err\n")
+
+    def test_sendall(self):
+        channel = self.execute("wc -c")
+        self.assertEqual(channel.sendall("x" * 500000), 500000)
+        channel.send_eof()
+        self.assertEqual(channel.read_all().strip(), "500000")
+
+    def test_sendall_nonblocking(self):
+        channel = self.execute("wc -c")
+        self.session.setblocking(0)
+        self.assertEqual(channel.sendall(bytearray(500000)), 500000)
+        self.session.setblocking(1)
+        channel.send_eof()
+        self.assertEqual(channel.read_all().strip(), "500000")
+
+    def test_sendfile(self):
+        channel = self.execute("cat")
+        with tempfile.TemporaryFile() as source:
+            source.write("".join(chr(i % 256) for i in range(200000)))
+            source.flush()
+            self.assertEqual(channel.sendfile(source, 1000, 150000), 150000)
+            channel.send_eof()
+            source.seek(1000)
+            self.assertEqual(channel.read_all(), source.read(150000))
+
+    def test_recv_into_fd(self):
+        channel = self.execute("head -c 200000 /dev/zero; printf err >&2")
+        with tempfile.TemporaryFile() as output:
+            with tempfile.TemporaryFile() as errors:
+                self.assertEqual(channel.recv_into_fd(output, errors),
+                                 (200000, 3))
+                output.seek(0)
+                errors.seek(0)
+                self.assertEqual(output.read(), "\0" * 200000)
+                self.assertEqual(errors.read(), "err")
+
+    def test_read_streams(self):
+        channel = self.execute("printf out; printf err >&2")
+        out, err = "", ""
+        while True:
+            streams = channel.read_streams(1024)
+            if streams is None:
+                break
+            out += streams[0]
+            err += streams[1]
+        self.assertEqual((out, err), ("out", "err"))
+
+    def test_read_auto_size(self):
+        channel = self.execute("head -c 300000 /dev/zero")
+        data = []
+        while True:
+            chunk = channel.read(-1)
+            if chunk is None:
+                break
+            self.assertTrue(0 < len(chunk) <= 1 << 20)
+            data.append(chunk)
+        self.assertEqual("".join(data), "\0" * 300000)
+        self.assertEqual(channel.read_ex(0), (0, ""))
+
+    def test_exec_stream(self):
+        channel = self.session.open_session()
+        streams = {0: "", 1: ""}
+        records = list(channel.exec_stream("echo out; echo err >&2; exit 3"))
+        for stream_id, data in records[:-1]:
+            streams[stream_id] += data
+        self.assertEqual(streams, {0: "out\n", 1: "err\n"})
+        self.assertEqual(records[-1], (libssh2.STREAM_EXIT_STATUS, 3))
+
+    def test_exec_stream_timeout(self):
+        channel = self.session.open_session()
+        stream = channel.exec_stream("sleep 2", timeout=0.1)
+        self.assertRaises(libssh2.TimeoutError, list, stream)
+
+    def test_iter_chunks(self):
+        channel = self.execute("head -c 100000 /dev/zero")
+        chunks = [str(chunk) for chunk in channel.iter_chunks(32768)]
+        self.assertEqual("".join(chunks), "\0" * 100000)
+        self.assertTrue(max(len(chunk) for chunk in chunks) <= 32768)
+
+    def test_iter_chunks_memoryview(self):
+        channel = self.execute("head -c 100000 /dev/zero")
+        data = []
+        for chunk in channel.iter_chunks(32768, memoryview=True):
+            self.assertTrue(0 < len(chunk) <= 32768)
+            self.assertEqual(len(chunk.tobytes()), len(chunk))
+            data.append(chunk[:].tobytes())
+        self.assertEqual("".join(data), "\0" * 100000)
+
+    def test_iter_chunks_concurrent_read(self):
+        channel = self.execute("sleep 1; echo done")
+        chunks = channel.iter_chunks()
+        data = []
+        reader = threading.Thread(target=lambda: data.append(str(next(chunks))))
+        reader.start()
+        time.sleep(0.2)
+        self.assertRaises(libssh2.Error, next, chunks)
+        reader.join()
+        self.assertEqual(data, ["done\n"])
+
+    def test_makefile(self):
+        channel = self.execute("printf 'one\\ntwo\\nthree'")
+        stream = channel.makefile()
+        self.assertEqual(stream.readline(), "one\n")
+        self.assertEqual(list(stream), ["two\n", "three"])
+
+    def test_makefile_concurrent_read(self):
+        channel = self.execute("sleep 1; echo done")
+        stream = channel.makefile()
+        lines = []
+        reader = threading.Thread(target=lambda: lines.append(stream.readline()))
+        reader.start()
+        time.sleep(0.2)
+        self.assertRaises(libssh2.Error, stream.read)
+        reader.join()
+        self.assertEqual(lines, ["done\n"])
+
+    def test_write_buffer(self):
+        channel = self.execute("cat")
+        data = bytearray("buffer data")
+        self.assertEqual(channel.write(memoryview(data)[:6]), 6)
+        self.assertEqual(channel.write(data[6:]), 5)
+        channel.send_eof()
+        self.assertEqual(channel.read_all(), "buffer data")
+
+    def test_writev(self):
+        channel = self.execute("cat")
+        fragments = ["a" * 10, "b" * 100000, "c", bytearray("d" * 5)]
+        self.assertEqual(channel.writev(fragments, 0, 5), 100016)
+        channel.send_eof()
+        self.assertEqual(channel.read_all(), "".join(map(str, fragments)))
+
+    def test_writev_nonblocking(self):
+        channel = self.execute("cat > /dev/null")
+        self.session.setblocking(0)
+        self.assertEqual(channel.writev(["x" * 65536] * 16), 1 << 20)
+
+    def test_read_streams_timeout(self):
+        channel = self.execute("sleep 2; echo out")
+        self.assertRaises(libssh2.TimeoutError, channel.read_streams, 10, 0.1)
+
+    def test_recv_into_fd_timeout(self):
+        channel = self.execute("sleep 2; echo out")
+        with tempfile.TemporaryFile() as output:
+            self.assertRaises(libssh2.TimeoutError, channel.recv_into_fd,
+                              output, None, 65536, 0.1)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,56 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Unit tests for run_many
+"""
+
+import unittest
+
+import libssh2
+
+from support import HOST, PORT, USER, PASSWORD
+
+class FleetTest(unittest.TestCase):
+    def setUp(self):
+        if PASSWORD is None:
+            self.skipTest("PYLIBSSH2_TEST_PASSWORD is not set")
+
+    def test_run_many(self):
+        hosts = [(HOST, PORT, USER, PASSWORD)] * 3
+        hosts.append((HOST, PORT, USER, PASSWORD + "-wrong"))
+        results = list(libssh2.run_many(hosts, "echo out; echo err >&2",
+                                        concurrency=2, timeout=10))
+        self.assertEqual(len(results), 4)
+        failed = [result for result in results if result.error is not None]
+        self.assertEqual(len(failed), 1)
+        self.assertTrue("authenticate" in failed[0].error)
+        for result in results:
+            if result.error is None:
+                self.assertEqual(result.exit_status, 0)
+                self.assertEqual(result.stdout, "out\n")
+                self.assertEqual(result.stderr, "err\n")
+
+    def test_run_many_timeout(self):
+        hosts = [(HOST, PORT, USER, PASSWORD)]
+        results = list(libssh2.run_many(hosts, "sleep 2", timeout=0.2))
+        self.assertEqual(results[0].error, "Operation timed out.")
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,76 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Unit tests for Poller
+"""
+
+import os
+import socket
+import unittest
+
+import libssh2
+
+from support import SessionTestCase, HOST, PORT, USER, PASSWORD
+
+class PollerTest(SessionTestCase):
+    def test_channel_ready(self):
+        channel = self.execute("sleep 0.2; echo done")
+        poller = libssh2.Poller()
+        poller.register(channel, libssh2.POLLER_IN)
+        self.assertEqual(poller.poll(0), [])
+        ready = poller.poll(5)
+        self.assertEqual(ready, [(channel, libssh2.POLLER_IN)])
+        self.assertEqual(channel.read(10), "done\n")
+        poller.unregister(channel)
+        self.assertEqual(poller.poll(0), [])
+
+    def test_high_descriptor(self):
+        # push the socket of the second session past the initial fd arrays
+        fillers = [os.open(os.devnull, os.O_RDONLY) for i in range(80)]
+        try:
+            sock = socket.create_connection((HOST, PORT))
+        finally:
+            for fd in fillers:
+                os.close(fd)
+        session = libssh2.Session()
+        try:
+            session.startup(sock)
+            session.userauth_password(USER, PASSWORD)
+            self.assertTrue(session.fileno() >= 64)
+            first = self.execute("echo one")
+            second = session.open_session()
+            second.execute("echo two")
+            poller = libssh2.Poller()
+            poller.register(first, libssh2.POLLER_IN)
+            poller.register(second, libssh2.POLLER_IN)
+            pending = set([first, second])
+            while pending:
+                for obj, events in poller.poll(5):
+                    self.assertEqual(events, libssh2.POLLER_IN)
+                    poller.unregister(obj)
+                    pending.discard(obj)
+            self.assertEqual(first.read(10), "one\n")
+            self.assertEqual(second.read(10), "two\n")
+        finally:
+            session.close()
+            sock.close()
+
+if __name__ == '__main__':
+    unittest.main()
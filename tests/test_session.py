@@ -13,8 +13,13 @@ Unit tests for Session
 """
 
 import socket
+import threading
+import time
 import unittest
 
+import support
+from support import SessionTestCase
+
 class SessionTest(unittest.TestCase):
     def setUp(self):
         self.socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -44,5 +49,240 @@ class SessionTest(unittest.TestCase):
     def tearDown(self):
         self.socket.close()
 
+class _Future(object):
+    def __init__(self):
+        self._done = False
+        self._result = None
+
+    def done(self):
+        return self._done
+
+    def set_result(self, result):
+        self._done, self._result = True, result
+
+    def set_exception(self, error):
+        self._done, self._result = True, error
+
+    def result(self):
+        return self._result
+
+class _Loop(object):
+    """
+    Minimal event loop recording the callbacks of a dispatcher.
+    """
+    def __init__(self):
+        self.soon = []
+        self.readers = {}
+        self.writers = {}
+
+    def create_future(self):
+        return _Future()
+
+    def call_soon(self, callback):
+        self.soon.append(callback)
+
+    def add_reader(self, fd, callback):
+        self.readers[fd] = callback
+
+    def remove_reader(self, fd):
+        del self.readers[fd]
+
+    def add_writer(self, fd, callback):
+        self.writers[fd] = callback
+
+    def remove_writer(self, fd):
+        del self.writers[fd]
+
+    def run_once(self):
+        soon, self.soon = self.soon, []
+        for callback in soon:
+            callback()
+
+class SessionLoopTest(unittest.TestCase):
+    def test_second_loop(self):
+        import libssh2
+        session = libssh2.Session()
+        first, second = _Loop(), _Loop()
+        blocked = [True]
+        def call():
+            if blocked[0]:
+                return -37
+            return "done"
+
+        pending = session._submit(first, call)
+        self.assertFalse(pending.done())
+        self.assertRaises(libssh2.SessionException, session._submit, second,
+                          call)
+
+        blocked[0] = False
+        first.run_once()
+        self.assertEqual(pending.result(), "done")
+
+        moved = session._submit(second, call)
+        self.assertEqual(moved.result(), "done")
+        self.assertEqual(first.readers, {})
+        self.assertEqual(first.writers, {})
+
+class SessionWaitTest(SessionTestCase):
+    def test_fileno(self):
+        self.assertEqual(self.session.fileno(), self.socket.fileno())
+
+    def test_wait(self):
+        import libssh2
+        channel = self.execute("sleep 0.2; echo done")
+        self.session.setblocking(0)
+        self.assertEqual(self.session.wait(0), 1)
+        data = channel.read(10)
+        while data == libssh2.LIBSSH2_ERROR_EAGAIN:
+            self.assertEqual(self.session.wait(5), 1)
+            data = channel.read(10)
+        self.assertEqual(data, "done\n")
+
+    def test_wait_timeout(self):
+        import libssh2
+        channel = self.execute("sleep 2")
+        self.session.setblocking(0)
+        self.assertEqual(channel.read(10), libssh2.LIBSSH2_ERROR_EAGAIN)
+        self.assertEqual(self.session.wait(0.1), 0)
+
+class SessionNonblockingTest(SessionTestCase):
+    def retry(self, call, *args):
+        self.session.setblocking(0)
+        result = call(*args)
+        while result is None:
+            self.assertEqual(self.session.wait(5), 1)
+            result = call(*args)
+        self.session.setblocking(1)
+        return result
+
+    def test_sftp_init(self):
+        sftp = self.retry(self.session._session.sftp_init)
+        sftp.shutdown()
+
+    def test_direct_tcpip(self):
+        channel = self.retry(self.session.direct_tcpip, "127.0.0.1",
+                             support.PORT, "127.0.0.1", 40000)
+        channel.close()
+
+class SessionThreadTest(SessionTestCase):
+    def test_shared_session(self):
+        results = []
+        def run(index):
+            channel = self.execute("echo %d" % index)
+            results.append((index, channel.read_all()))
+            channel.close()
+        threads = [threading.Thread(target=run, args=(i,)) for i in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(sorted(results),
+                         [(i, "%d\n" % i) for i in range(8)])
+
+class SessionKeepaliveTest(SessionTestCase):
+    def test_keepalive_send(self):
+        self.assertEqual(self.session.keepalive_send(), 0)
+        self.session.keepalive_config(False, 5)
+        self.assertTrue(0 < self.session.keepalive_send() <= 5)
+
+    def test_keepalive_driver(self):
+        import libssh2
+        keepalive = libssh2.Keepalive()
+        try:
+            keepalive.register(self.session, True, 1)
+            time.sleep(2.5)
+            channel = self.execute("echo alive")
+            self.assertEqual(channel.read_all(), "alive\n")
+            keepalive.unregister(self.session)
+        finally:
+            keepalive.stop()
+
+class SessionTimeoutTest(SessionTestCase):
+    def test_call_timeout_keeps_session_timeout(self):
+        import libssh2
+        self.session.set_timeout(5)
+        channel = self.execute("sleep 2")
+        self.assertRaises(libssh2.TimeoutError, channel.read, 10, 0.1)
+        self.assertEqual(self.session.get_timeout(), 5)
+
+    def test_short_timeout(self):
+        import libssh2
+        self.session.set_timeout(0.0005)
+        self.assertEqual(self.session.get_timeout(), 0.001)
+        channel = self.execute("sleep 2")
+        self.assertRaises(libssh2.TimeoutError, channel.read, 10)
+
+    def test_set_timeout_during_call(self):
+        import libssh2
+        channel = self.execute("sleep 1")
+        reader = threading.Thread(target=channel.read, args=(10, 3))
+        reader.start()
+        self.session.set_timeout(7)
+        reader.join()
+        self.assertEqual(self.session.get_timeout(), 7)
+
+    def test_nonblocking_open_session(self):
+        self.session.setblocking(0)
+        channel = self.session.open_session()
+        while channel is None:
+            self.session.wait(1)
+            channel = self.session.open_session()
+        channel.close()
+
+class SessionPoolTest(unittest.TestCase):
+    def setUp(self):
+        if support.PASSWORD is None:
+            self.skipTest("PYLIBSSH2_TEST_PASSWORD is not set")
+        import libssh2
+        self.key = (support.HOST, support.PORT, support.USER)
+        self.pool = libssh2.SessionPool(max_sessions=2, max_channels=1,
+                                        idle_timeout=0.2,
+                                        keepalive_interval=0)
+        self.pool.register(*self.key, password=support.PASSWORD)
+
+    def test_reuse(self):
+        for i in range(3):
+            channel = self.pool.open_session(*self.key)
+            channel.execute("true")
+            channel.close()
+        self.assertEqual(self.pool.sessions(*self.key), 1)
+
+    def test_discard_keeps_open_channels(self):
+        import libssh2
+        pool = libssh2.SessionPool(max_channels=2, keepalive_interval=0)
+        pool.register(*self.key, password=support.PASSWORD)
+        channel = pool.open_session(*self.key)
+        entry = pool._acquire(self.key, None)
+        pool._discard(entry)
+        self.assertEqual(pool.sessions(*self.key), 0)
+        channel.execute("echo alive")
+        self.assertEqual(channel.read_all(), "alive\n")
+        channel.close()
+        self.assertRaises(libssh2.Error, entry.session.open_session)
+        pool.close()
+
+    def test_broken_uses_error_code(self):
+        import libssh2
+        entry = self.pool._acquire(self.key, None)
+        refused = libssh2.Error("Failed to open channel")
+        refused.code = -21
+        self.assertFalse(self.pool._broken(entry, refused))
+        dropped = libssh2.Error("Failed to open channel")
+        dropped.code = -7
+        self.assertTrue(self.pool._broken(entry, dropped))
+        self.pool._release(entry)
+
+    def test_evict_on_release(self):
+        first = self.pool.open_session(*self.key)
+        second = self.pool.open_session(*self.key)
+        self.assertEqual(self.pool.sessions(*self.key), 2)
+        first.close()
+        time.sleep(0.3)
+        second.close()
+        self.assertEqual(self.pool.sessions(*self.key), 1)
+
+    def tearDown(self):
+        self.pool.close()
+
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,173 @@
+#
+# pylibssh2 - python bindings for libssh2 library
+#
+# Copyright (C) 2010 Wallix Inc.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by the
+# Free Software Foundation; either version 2.1 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+# details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+"""
+Unit tests for Sftp
+"""
+
+import os
+import tempfile
+import unittest
+
+import _libssh2
+import libssh2
+
+from support import SessionTestCase
+
+class SftpTest(SessionTestCase):
+    def setUp(self):
+        SessionTestCase.setUp(self)
+        self.sftp = self.session._session.sftp_init()
+        self.path = "/tmp/pylibssh2-test-%d" % os.getpid()
+
+    def tearDown(self):
+        try:
+            self.sftp.unlink(self.path)
+        except libssh2.Error:
+            pass
+        SessionTestCase.tearDown(self)
+
+    def write_file(self, data):
+        handle = self.sftp.open(self.path, "w")
+        handle.write(data)
+        handle.close()
+
+    def test_get(self):
+        data = os.urandom(300000)
+        self.write_file(data)
+        with tempfile.TemporaryFile() as local:
+            self.assertEqual(self.sftp.get(self.path, local, 4096, 8), len(data))
+            local.seek(0)
+            self.assertEqual(local.read(), data)
+
+    def test_get_missing(self):
+        with tempfile.TemporaryFile() as local:
+            self.assertRaises(libssh2.Error, self.sftp.get,
+                              self.path + "-missing", local)
+
+    def test_put(self):
+        data = os.urandom(300000)
+        with tempfile.NamedTemporaryFile() as local:
+            local.write(data)
+            local.flush()
+            self.assertEqual(self.sftp.put(local.name, self.path, 4096, 8),
+                             len(data))
+        handle = self.sftp.open(self.path, "r")
+        self.assertEqual(handle.read(), data)
+        handle.close()
+
+    def test_put_pipe(self):
+        read_fd, write_fd = os.pipe()
+        os.write(write_fd, "piped data")
+        os.close(write_fd)
+        try:
+            self.assertEqual(self.sftp.put(read_fd, self.path), 10)
+        finally:
+            os.close(read_fd)
+        handle = self.sftp.open(self.path, "r")
+        self.assertEqual(handle.read(), "piped data")
+        handle.close()
+
+    def test_readinto(self):
+        self.write_file("0123456789" * 1000)
+        handle = self.sftp.open(self.path, "r")
+        buffer = bytearray(4096)
+        view = memoryview(buffer)
+        data = []
+        while True:
+            rc = self.sftp.readinto(handle, view[:1000])
+            if rc == 0:
+                break
+            data.append(str(buffer[:rc]))
+        self.assertEqual("".join(data), "0123456789" * 1000)
+        handle.close()
+
+    def test_handle_write_read(self):
+        data = "".join("line %d\n" % i for i in range(20000))
+        handle = self.sftp.open(self.path, "w")
+        for i in range(0, len(data), 1000):
+            handle.write(data[i:i + 1000])
+        self.assertEqual(handle.tell(), len(data))
+        handle.close()
+
+        handle = self.sftp.open(self.path, "r")
+        self.assertEqual(handle.read(5), "line ")
+        self.assertEqual(handle.readline(), "0\n")
+        self.assertEqual(handle.read(), data[7:])
+        self.assertEqual(handle.read(), "")
+        handle.close()
+
+    def test_handle_iter_seek(self):
+        self.write_file("one\ntwo\nthree\n")
+        handle = self.sftp.open(self.path, "r")
+        self.assertEqual(list(handle), ["one\n", "two\n", "three\n"])
+        self.assertEqual(handle.seek(-6, 2), 8)
+        self.assertEqual(handle.read(), "three\n")
+        self.assertEqual(handle.seek(4), 4)
+        buffer = bytearray(3)
+        self.assertEqual(handle.readinto(buffer), 3)
+        self.assertEqual(buffer, "two")
+        self.assertEqual(handle.fstat()[0], 14)
+        handle.close()
+        handle.close()
+        self.assertRaises(ValueError, handle.read)
+
+    def test_handle_after_shutdown(self):
+        self.write_file("data")
+        handle = self.sftp.open(self.path, "r")
+        self.sftp.shutdown()
+        self.assertRaises(libssh2.Error, handle.read)
+        self.assertRaises(libssh2.Error, handle.fstat)
+        handle.close()
+        self.sftp = self.session._session.sftp_init()
+
+    def test_path_calls_timeout(self):
+        directory = self.path + ".d"
+        self.assertEqual(self.sftp.mkdir(directory, 0755, 5), 0)
+        handle = self.sftp.opendir(os.path.dirname(directory), 5)
+        self.assertFalse(self.sftp.readdir(handle, 5) is None)
+        handle.close()
+        self.assertEqual(self.sftp.rmdir(directory, 5), 0)
+
+        handle = self.sftp.open(self.path, "w", 0644, 5)
+        handle.write("data")
+        handle.close()
+        attrs = self.sftp.get_stat(self.path, _libssh2.SFTP_STAT, 5)
+        self.assertEqual(attrs[0], 4)
+        self.assertEqual(self.sftp.realpath(self.path, _libssh2.SFTP_REALPATH,
+                                            5), self.path)
+        self.assertEqual(self.sftp.rename(self.path, self.path + ".new", 5), 0)
+        self.assertEqual(self.sftp.unlink(self.path + ".new", 5), 0)
+
+    def test_scandir(self):
+        self.write_file("data")
+        entries = dict((entry.name, entry)
+                       for entry in self.sftp.scandir(os.path.dirname(self.path)))
+        entry = entries[os.path.basename(self.path)]
+        self.assertEqual(entry.size, 4)
+        self.assertFalse("." in entries or ".." in entries)
+
+    def test_scandir_after_shutdown(self):
+        entries = self.sftp.scandir("/")
+        self.sftp.shutdown()
+        self.assertRaises(libssh2.Error, next, entries)
+        self.sftp = self.session._session.sftp_init()
+
+if __name__ == '__main__':
+    unittest.main()